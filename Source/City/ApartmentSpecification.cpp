@@ -22,9 +22,11 @@ FRoomInfo ApartmentSpecification::buildApartment(FRoomPolygon *f, int floor, flo
 
 	TArray<FRoomPolygon*> roomPols = f->getRooms(getBlueprint(1.0f));
 	intermediateInteractWithRooms(roomPols, r, map, potentialBalcony);
+	// a copy so the furniture doesn't change the windows, floors can be built on several threads so it can't come from the shared stream either
+	FRandomStream furnitureStream = stream;
 	for (FRoomPolygon *r2 : roomPols) {
 		if (!shellOnly) {
-			ARoomBuilder::buildSpecificRoom(r, r2, map);
+			ARoomBuilder::buildSpecificRoom(r, r2, map, furnitureStream);
 			placeEntranceMeshes(r, r2);
 		}
 	}
@@ -2,6 +2,15 @@
 
 #include "City.h"
 #include "BaseLibrary.h"
+#include "Async/ParallelFor.h"
+
+// the collision projections use SSE on x86, everywhere else they fall back to plain loops
+#if PLATFORM_ENABLE_VECTORINTRINSICS && (defined(_M_X64) || defined(__x86_64__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1) || defined(__SSE__))
+#define SAT_SSE 1
+#include <xmmintrin.h>
+#else
+#define SAT_SSE 0
+#endif
 
 BaseLibrary::BaseLibrary()
 {
@@ -12,6 +21,15 @@ BaseLibrary::~BaseLibrary()
 }
 
 bool BaseLibrary::overrideSides = false;
+bool BaseLibrary::localCoordinates = false;
+bool FPolygon::useBoundsEarlyOut = true;
+
+FVector BaseLibrary::getLocalOrigin(const FPolygon &p) {
+	if (p.points.Num() == 0)
+		return FVector(0, 0, 0);
+	FVector2D center = p.getBounds().GetCenter();
+	return FVector(FMath::RoundToFloat(center.X / 100) * 100, FMath::RoundToFloat(center.Y / 100) * 100, 0);
+}
 
 FPolygon getTinyPolygon(FVector point) {
 	FPolygon temp;
@@ -29,7 +47,7 @@ FVector getRandomPointOnLine(FVector start, FVector end, float minDistFromEdges,
 	return start + tan * stream.FRandRange(minDistFromEdges, tanLen - minDistFromEdges);
 }
 
-void getMinMax(float &min, float &max, FVector tangent, TArray<FVector> points) {
+void getMinMax(float &min, float &max, FVector tangent, const TArray<FVector> &points) {
 	if (points.Num() == 0)
 		return;
 
@@ -43,28 +61,97 @@ void getMinMax(float &min, float &max, FVector tangent, TArray<FVector> points)
 	}
 }
 
+SATPolygon::SATPolygon(const TArray<FVector> &points) {
+	int32 num = points.Num();
+	int32 padded = (num + 3) & ~3;
+	x.SetNumUninitialized(padded);
+	y.SetNumUninitialized(padded);
+	for (int32 i = 0; i < padded; i++) {
+		const FVector &point = points[std::min(i, num - 1)];
+		x[i] = point.X;
+		y[i] = point.Y;
+	}
+}
+
+void SATPolygon::project(float ax, float ay, float &min, float &max) const {
+	const float *px = x.GetData();
+	const float *py = y.GetData();
+	const int32 num = x.Num();
+#if SAT_SSE
+	__m128 axisX = _mm_set1_ps(ax);
+	__m128 axisY = _mm_set1_ps(ay);
+	__m128 lowest = _mm_set1_ps(FLT_MAX);
+	__m128 highest = _mm_set1_ps(-FLT_MAX);
+	for (int32 i = 0; i < num; i += 4) {
+		__m128 dot = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(px + i), axisX), _mm_mul_ps(_mm_loadu_ps(py + i), axisY));
+		lowest = _mm_min_ps(lowest, dot);
+		highest = _mm_max_ps(highest, dot);
+	}
+	lowest = _mm_min_ps(lowest, _mm_shuffle_ps(lowest, lowest, _MM_SHUFFLE(2, 3, 0, 1)));
+	lowest = _mm_min_ps(lowest, _mm_shuffle_ps(lowest, lowest, _MM_SHUFFLE(1, 0, 3, 2)));
+	highest = _mm_max_ps(highest, _mm_shuffle_ps(highest, highest, _MM_SHUFFLE(2, 3, 0, 1)));
+	highest = _mm_max_ps(highest, _mm_shuffle_ps(highest, highest, _MM_SHUFFLE(1, 0, 3, 2)));
+	min = _mm_cvtss_f32(lowest);
+	max = _mm_cvtss_f32(highest);
+#else
+	min = FLT_MAX;
+	max = -FLT_MAX;
+	for (int32 i = 0; i < num; i++) {
+		float dot = px[i] * ax + py[i] * ay;
+		min = std::min(min, dot);
+		max = std::max(max, dot);
+	}
+#endif
+}
+
+bool testSATAxis(const SATPolygon &p1, const SATPolygon &p2, float ax, float ay, float leniency) {
+	float min1;
+	float max1;
+	float min2;
+	float max2;
+	p1.project(ax, ay, min1, max1);
+	p2.project(ax, ay, min2, max2);
+	return std::max(min1, min2) < std::min(max1, max2) - leniency;
+}
+
 // finds the first intersection point (if any) between a polygon and a list of potentially colliding polygons
-FVector intersection(FPolygon &p1, TArray<FPolygon> &p2) {
+SegmentHit intersection(FPolygon &p1, TArray<FPolygon> &p2) {
 	for (FPolygon &f : p2) {
-		FVector res = intersection(p1, f);
-		if (res.X != 0.0f) {
+		SegmentHit res = intersection(p1, f);
+		if (res.hit) {
 			return res;
 		}
 	}
-	return FVector(0.0f, 0.0f, 0.0f);
+	return SegmentHit();
 }
 
-// finds the first intersection point (if any) between two polygons via brute force (n^2)
-FVector intersection(FPolygon &p1, FPolygon &p2) {
+// true if the boxes can't hold anything in common, touching boxes still count as overlapping
+static bool boundsApart(const FBox2D &a, const FBox2D &b, float margin = 0.0f) {
+	return a.Max.X + margin < b.Min.X || b.Max.X + margin < a.Min.X || a.Max.Y + margin < b.Min.Y || b.Max.Y + margin < a.Min.Y;
+}
+
+static FBox2D getSegmentBounds(FVector p1, FVector p2) {
+	return FBox2D(FVector2D(std::min(p1.X, p2.X), std::min(p1.Y, p2.Y)), FVector2D(std::max(p1.X, p2.X), std::max(p1.Y, p2.Y)));
+}
+
+// finds the first intersection point (if any) between two polygons via brute force (n^2), index is the side of p1 that was hit
+SegmentHit intersection(FPolygon &p1, FPolygon &p2) {
+	const bool earlyOut = FPolygon::useBoundsEarlyOut;
+	if (earlyOut && boundsApart(p1.getBounds(), p2.getBounds()))
+		return SegmentHit();
 	for (int i = 1; i < p1.points.Num()+1; i++) {
-		for (int j = 1; j < p2.points.Num()+1; j++) {
-			FVector res = intersection(p1.points[i - 1], p1.points[i%p1.points.Num()], p2.points[j - 1], p2.points[j%p2.points.Num()]);
-			if (res.X != 0.0f) {
-				return res;
-			}
+		// only the edges of p1 reaching into p2 can cross it
+		if (earlyOut && boundsApart(getSegmentBounds(p1.points[i - 1], p1.points[i%p1.points.Num()]), p2.getBounds()))
+			continue;
+		SegmentHit res = intersection(p1.points[i - 1], p1.points[i%p1.points.Num()], p2.points.GetData(), p2.points.Num(), true);
+		if (res.hit) {
+			// the polyline test reports the side of p2, swap to the side of p1
+			Swap(res.t, res.u);
+			res.index = i;
+			return res;
 		}
 	}
-	return FVector(0.0f, 0.0f, 0.0f);
+	return SegmentHit();
 }
 
 // a pretty inefficient method for checking whether any of the lines in the polygon intersects another (n^2)
@@ -75,103 +162,203 @@ bool selfIntersection(FPolygon &p) {
 			tan1.Normalize();
 			FVector tan2 = p.points[j%p.points.Num()] - p.points[j - 1];
 			tan2.Normalize();
-			if (intersection(p.points[i - 1] + tan1, p.points[i%p.points.Num()] - tan1, p.points[j - 1] + tan2, p.points[j%p.points.Num()] - tan2).X != 0.0f)
+			if (intersection(p.points[i - 1] + tan1, p.points[i%p.points.Num()] - tan1, p.points[j - 1] + tan2, p.points[j%p.points.Num()] - tan2).hit)
 				return true;
 		}
 	}
 	return false;
 }
 
-FVector intersection(FVector p1, FVector p2, FVector p3, FVector p4) {
+SegmentHit intersection(FVector p1, FVector p2, FVector p3, FVector p4, float epsilon) {
+	SegmentHit res;
 	float p0_x = p1.X;
 	float p0_y = p1.Y;
-	float p1_x = p2.X;
-	float p1_y = p2.Y;
 	float p2_x = p3.X;
 	float p2_y = p3.Y;
-	float p3_x = p4.X;
-	float p3_y = p4.Y;
 
 	float s1_x, s1_y, s2_x, s2_y;
-	s1_x = p1_x - p0_x;     s1_y = p1_y - p0_y;
-	s2_x = p3_x - p2_x;     s2_y = p3_y - p2_y;
+	s1_x = p2.X - p0_x;     s1_y = p2.Y - p0_y;
+	s2_x = p4.X - p2_x;     s2_y = p4.Y - p2_y;
+
+	// parallel segments and segments without length are never hit, relative to the lengths so it works at any scale
+	float denom = -s2_x * s1_y + s1_x * s2_y;
+	if (denom * denom <= 1e-12f * (s1_x * s1_x + s1_y * s1_y) * (s2_x * s2_x + s2_y * s2_y))
+		return res;
 
 	float s, t;
-	s = (-s1_y * (p0_x - p2_x) + s1_x * (p0_y - p2_y)) / (-s2_x * s1_y + s1_x * s2_y);
-	t = (s2_x * (p0_y - p2_y) - s2_y * (p0_x - p2_x)) / (-s2_x * s1_y + s1_x * s2_y);
+	s = (-s1_y * (p0_x - p2_x) + s1_x * (p0_y - p2_y)) / denom;
+	t = (s2_x * (p0_y - p2_y) - s2_y * (p0_x - p2_x)) / denom;
 
-	if (s >= 0 && s <= 1 && t >= 0 && t <= 1)
+	if (s >= -epsilon && s <= 1 + epsilon && t >= -epsilon && t <= 1 + epsilon)
 	{
 		// Collision detected
-		return FVector(p0_x + (t * s1_x), p0_y + (t * s1_y), 0);
+		res.hit = true;
+		res.t = t;
+		res.u = s;
+		res.point = FVector(p0_x + (t * s1_x), p0_y + (t * s1_y), p1.Z + t * (p2.Z - p1.Z));
 	}
 
-	return FVector(0.0f, 0.0f, 0.0f); // No collision
+	return res;
 }
 
-FVector intersection(FVector p1, FVector p2, FPolygon p) {
-	for (int i = 1; i < p.points.Num()+1; i++) {
-		FVector res = intersection(p1, p2, p.points[i - 1], p.points[i%p.points.Num()]);
-		if (res.X != 0.0f) {
+SegmentHit intersection(FVector p1, FVector p2, const FVector *points, int32 num, bool closed, bool closest, int32 skip, float epsilon) {
+	SegmentHit best;
+	int32 edges = closed ? num : num - 1;
+	for (int32 i = 1; i < edges + 1; i++) {
+		if (i == skip)
+			continue;
+		SegmentHit res = intersection(p1, p2, points[i - 1], points[i%num], epsilon);
+		if (!res.hit)
+			continue;
+		if (!closest) {
+			res.index = i;
 			return res;
 		}
+		if (!best.hit || res.t < best.t) {
+			best = res;
+			best.index = i;
+		}
 	}
-	return FVector(0.0f, 0.0f, 0.0f);
+	return best;
 }
 
+void RoadSegmentGrid::add(int32 id, FVector p1, FVector p2, float margin) {
+	int32 minX = FMath::FloorToInt((std::min(p1.X, p2.X) - margin) / cellSize);
+	int32 maxX = FMath::FloorToInt((std::max(p1.X, p2.X) + margin) / cellSize);
+	int32 minY = FMath::FloorToInt((std::min(p1.Y, p2.Y) - margin) / cellSize);
+	int32 maxY = FMath::FloorToInt((std::max(p1.Y, p2.Y) + margin) / cellSize);
+	for (int32 x = minX; x <= maxX; x++) {
+		for (int32 y = minY; y <= maxY; y++) {
+			uint64 key = packCellKey(x, y);
+			int32* head = heads.Find(key);
+			next.Add(head ? *head : INDEX_NONE);
+			ids.Add(id);
+			heads.Add(key, ids.Num() - 1);
+		}
+	}
+}
 
+void RoadSegmentGrid::query(FVector p1, FVector p2, float margin, TArray<int32> &out) const {
+	out.Reset();
+	int32 minX = FMath::FloorToInt((std::min(p1.X, p2.X) - margin) / cellSize);
+	int32 maxX = FMath::FloorToInt((std::max(p1.X, p2.X) + margin) / cellSize);
+	int32 minY = FMath::FloorToInt((std::min(p1.Y, p2.Y) - margin) / cellSize);
+	int32 maxY = FMath::FloorToInt((std::max(p1.Y, p2.Y) + margin) / cellSize);
+	for (int32 x = minX; x <= maxX; x++) {
+		for (int32 y = minY; y <= maxY; y++) {
+			const int32* head = heads.Find(packCellKey(x, y));
+			for (int32 n = head ? *head : INDEX_NONE; n != INDEX_NONE; n = next[n]) {
+				out.Add(ids[n]);
+			}
+		}
+	}
+	// segments spanning several cells show up more than once
+	out.Sort();
+	int32 unique = 0;
+	for (int32 i = 0; i < out.Num(); i++) {
+		if (unique == 0 || out[unique - 1] != out[i])
+			out[unique++] = out[i];
+	}
+	out.SetNum(unique, false);
+}
 
-bool testAxis(FVector axis, FPolygon &p1, FPolygon &p2, float leniency) {
-	float min1;
-	float max1;
-	float min2;
-	float max2;
+void RoadSegmentGrid::reset(float newCellSize) {
+	cellSize = newCellSize;
+	heads.Reset();
+	ids.Reset();
+	next.Reset();
+}
 
-	getMinMax(min1, max1, axis, p1.points);
-	getMinMax(min2, max2, axis, p2.points);
-	if (std::max(min1, min2) >= std::min(max1, max2) - leniency) {
-		return false;
-	}
-	else {
-		return true;
+void RepulsionField::add(FVector point) {
+	int32 minX = FMath::FloorToInt((point.X - range) / spacing);
+	int32 maxX = FMath::CeilToInt((point.X + range) / spacing);
+	int32 minY = FMath::FloorToInt((point.Y - range) / spacing);
+	int32 maxY = FMath::CeilToInt((point.Y + range) / spacing);
+	for (int32 x = minX; x <= maxX; x++) {
+		for (int32 y = minY; y <= maxY; y++) {
+			float dist = FVector2D::Distance(FVector2D(x * spacing, y * spacing), FVector2D(point.X, point.Y));
+			if (dist < range)
+				nodes.FindOrAdd(packCellKey(x, y)) += impact * (range - dist) / range;
+		}
 	}
 }
 
-// check whether two polygons overlap with potential collision leniency
-bool testCollision(FPolygon &p1, FPolygon &p2, float leniency) {
+float RepulsionField::sample(FVector point) const {
+	float fx = point.X / spacing;
+	float fy = point.Y / spacing;
+	int32 x = FMath::FloorToInt(fx);
+	int32 y = FMath::FloorToInt(fy);
+	float ax = fx - x;
+	float ay = fy - y;
+	const float* n00 = nodes.Find(packCellKey(x, y));
+	const float* n10 = nodes.Find(packCellKey(x + 1, y));
+	const float* n01 = nodes.Find(packCellKey(x, y + 1));
+	const float* n11 = nodes.Find(packCellKey(x + 1, y + 1));
+	float bottom = FMath::Lerp(n00 ? *n00 : 0.0f, n10 ? *n10 : 0.0f, ax);
+	float top = FMath::Lerp(n01 ? *n01 : 0.0f, n11 ? *n11 : 0.0f, ax);
+	return FMath::Lerp(bottom, top, ay);
+}
+
+void RepulsionField::reset(float newRange, float newImpact) {
+	range = std::max(newRange, 1.0f);
+	impact = newImpact;
+	spacing = range / nodesPerRange;
+	nodes.Reset();
+}
+
+SegmentHit intersection(FVector p1, FVector p2, const FPolygon &p) {
+	if (FPolygon::useBoundsEarlyOut && boundsApart(getSegmentBounds(p1, p2), p.getBounds()))
+		return SegmentHit();
+	return intersection(p1, p2, p.points.GetData(), p.points.Num(), true);
+}
+
+
+
+// separating axis test along the edge normals of both polygons, the polygons are only ever looked at in X and Y
+static bool testCollision(const FPolygon &p1, const SATPolygon &s1, const FPolygon &p2, const SATPolygon &s2, float leniency) {
 	for (int i = 1; i < p1.points.Num()+1; i++) {
-		if (!testAxis(getNormal(p1.points[i%p1.points.Num()], p1.points[i-1], true), p1, p2, leniency)) {
+		FVector axis = getNormal(p1.points[i%p1.points.Num()], p1.points[i-1], true);
+		if (!testSATAxis(s1, s2, axis.X, axis.Y, leniency)) {
 			return false;
 		}
 	}
 	for (int i = 1; i < p2.points.Num()+1; i++) {
-		if (!testAxis(getNormal(p2.points[i%p2.points.Num()], p2.points[i-1], true), p1, p2, leniency)){//FRotator(0, 90, 0).RotateVector(p2.points[i] - p2.points[i-1]), p1, p2, leniency)) {
+		FVector axis = getNormal(p2.points[i%p2.points.Num()], p2.points[i-1], true);
+		if (!testSATAxis(s1, s2, axis.X, axis.Y, leniency)) {
 			return false;
 		}
 	}
 	return true;
 }
 
+// check whether two polygons overlap with potential collision leniency
+bool testCollision(FPolygon &p1, FPolygon &p2, float leniency) {
+	// a negative leniency makes polygons close to each other collide too
+	if (FPolygon::useBoundsEarlyOut && boundsApart(p1.getBounds(), p2.getBounds(), std::max(-leniency, 0.0f)))
+		return false;
+	return testCollision(p1, SATPolygon(p1.points), p2, SATPolygon(p2.points), leniency);
+}
+
 // check that a polygon doesn't collide with any other polygon and is inside of the surrounding polygon
 bool testCollision(FPolygon &in, TArray<FPolygon> &others, float leniency, FPolygon &surrounding) {
+	// the polygon being tested is only split up once for all of the others
+	SATPolygon inPoints(in.points);
 	for (FPolygon &other : others) {
-		if (testCollision(other, in, leniency)) {
+		if (FPolygon::useBoundsEarlyOut && boundsApart(other.getBounds(), in.getBounds(), std::max(-leniency, 0.0f)))
+			continue;
+		if (testCollision(other, SATPolygon(other.points), in, inPoints, leniency)) {
 			return true;
 		}
 	}
-	return intersection(in, surrounding).X != 0.0f || !testCollision(in, surrounding, leniency);
+	return intersection(in, surrounding).hit || !testCollision(in, surrounding, leniency);
 }
 
 // returns true if colliding
-bool testCollision(TArray<FVector> tangents, TArray<FVector> vertices1, TArray<FVector> vertices2, float collisionLeniency) {
-	float min1;
-	float max1;
-	float min2;
-	float max2;
-	for (FVector t : tangents) {
-		getMinMax(min1, max1, t, vertices1);
-		getMinMax(min2, max2, t, vertices2);
-		if (std::max(min1, min2) >= (std::min(max1, max2) - collisionLeniency)) {
+bool testCollision(const TArray<FVector> &tangents, const TArray<FVector> &vertices1, const TArray<FVector> &vertices2, float collisionLeniency) {
+	SATPolygon s1(vertices1);
+	SATPolygon s2(vertices2);
+	for (const FVector &t : tangents) {
+		if (!testSATAxis(s1, s2, t.X, t.Y, collisionLeniency)) {
 			return false;
 		}
 	}
@@ -186,40 +373,6 @@ FVector NearestPointOnLine(FVector linePnt, FVector lineDir, FVector pnt)
 	return linePnt + lineDir * d;
 }
 
-struct LinkedLine {
-	FLine line;
-	FVector point = FVector(0.0f, 0.0f, 0.0f);
-	LinkedLine* parent;
-	LinkedLine* child;
-};
-
-
-FVector getProperIntersection(FVector p1, FVector p2, FVector p3, FVector p4) {
-	// check if they collide into each other from the back
-	FVector otherTangent = p2 - p1;
-	otherTangent = FRotator(0, 90, 0).RotateVector(otherTangent);
-	otherTangent.Normalize();
-	float backLen = 300;
-	FVector res = intersection(p2 + otherTangent * backLen, p2 - otherTangent * backLen, p3, p4);
-	if (res.X == 0.0f) {
-		res = intersection(p1 + otherTangent * backLen, p1 - otherTangent * backLen, p3, p4);
-		if (res.X == 0.0f) {
-			// FVector otherTangent2 = FRotator(0, 90, 0).RotateVector(otherTangent2); // otherTangent2 should not be used in its own construction
-			// probably was been pulling random data, causing "heisenbug", with random polygons, and very, very long loops+recursion
-
-			// res = intersection(p1, p2, p3 - otherTangent2*backLen, p3 + otherTangent2*backLen); // disable buggy intersection tests for now
-			if (res.X == 0.0f) {
-				// res = intersection(p1, p2, p4 - otherTangent2*backLen, p4 + otherTangent2*backLen);
-				if (res.X == 0.0f) {
-					res = intersection(p1, p2, p3, p4);
-				}
-			}
-		}
-
-	}
-	return res;
-}
-
 TArray<FPolygon> getBlockingEntrances(TArray<FVector> points, TSet<int32> entrances, TMap<int32, FVector> specificEntrances, float entranceWidth, float blockingLength) {
 	TArray<FPolygon> blocking;
 	for (int i : entrances) {
@@ -240,269 +393,329 @@ TArray<FPolygon> getBlockingEntrances(TArray<FVector> points, TSet<int32> entran
 }
 
 
-// this method takes a line from one side of a road and finds its place among other lines already placed
-void decidePolygonFate(TArray<FRoadSegment> &segments, TArray<FRoadSegment> &blocking, LinkedLine* &inLine, TArray<LinkedLine*> &lines, bool allowSplit, float extraRoadLen, float width, float middleOffset, int depth)
-{
-	float len = FVector::Dist(inLine->line.p1, inLine->line.p2);
+// merges points closer than tolerance into a single vertex
+struct VertexWelder {
+	VertexWelder(float tolerance, TArray<FVector> &points) : tolerance(tolerance), points(points) {}
 
-	float minRoadLen = 3000;
-	if (len < minRoadLen || depth > 3) {
-		delete inLine;
-		return;
-	}
-
-	// split lines blocking roads
-
-	FVector tangent1 = inLine->line.p2 - inLine->line.p1;
-	tangent1.Normalize();
-	FVector tangent2 = FRotator(0, 90, 0).RotateVector(tangent1);
-	TArray<FVector> lineVertices;
-	FVector v1 = inLine->line.p1 + width * tangent2;
-	FVector v2 = inLine->line.p1 - width * tangent2;
-	FVector v4 = inLine->line.p2 - width * tangent2;
-	FVector v3 = inLine->line.p2 + width * tangent2;
-	lineVertices.Add(v1);
-	lineVertices.Add(v2);
-	lineVertices.Add(v3);
-	lineVertices.Add(v4);
-
-	// remember this line is on the side of a road, so we check this line for any potential collisions with other roads, or we'd create polygons that overlap roads, if we find that we collide with a road, we split our line there to create two new smaller lines, these then need to perform the same process to make sure they don't still collide with other roads
-	for (FRoadSegment f : blocking) {
-		FVector tangent = f.p2 - f.p1;
-		tangent.Normalize();
-		float toUseExtraLen = extraRoadLen;
-		FVector intSec = getProperIntersection(f.p1 - tangent*toUseExtraLen, f.p2 + tangent*toUseExtraLen, inLine->line.p1, inLine->line.p2);
-		if (intSec.X != 0.0f) {
-			if (!allowSplit) {
-				delete inLine;
-				return;
-			}
-
-			FVector altTangent = FRotator(0, 90, 0).RotateVector(tangent);
-			LinkedLine* newP = new LinkedLine();
-			float diff1 = FVector::DistSquared(intSec, inLine->line.p1) - FVector::DistSquared(intSec + altTangent * middleOffset, inLine->line.p1);
-			float diff2 = FVector::DistSquared(intSec, inLine->line.p2) - FVector::DistSquared(intSec + altTangent * middleOffset, inLine->line.p2);
-
-			if (diff1 > diff2) {
-				// 1 got closer, so use 1
-				newP->line.p1 = inLine->line.p1;
-				newP->line.p2 = intSec + altTangent * middleOffset;
-				inLine->line.p1 = intSec - altTangent * middleOffset;
-			}
-			else {
-				// 1 got further away, use 2 instead
-				newP->line.p1 = intSec + altTangent * middleOffset;
-				newP->line.p2 = inLine->line.p2;
-				inLine->line.p2 = intSec - altTangent * middleOffset;
+	int32 get(FVector point) {
+		int32 x = FMath::FloorToInt(point.X / tolerance);
+		int32 y = FMath::FloorToInt(point.Y / tolerance);
+		for (int32 i = x - 1; i <= x + 1; i++) {
+			for (int32 j = y - 1; j <= y + 1; j++) {
+				const TArray<int32> *cell = cells.Find(packCellKey(i, j));
+				if (!cell)
+					continue;
+				for (int32 index : *cell) {
+					if (FVector::DistSquared2D(points[index], point) < tolerance * tolerance)
+						return index;
+				}
 			}
-
-			decidePolygonFate(segments, blocking, newP, lines, true, extraRoadLen, width, middleOffset, depth+1);
-			intSec = getProperIntersection(f.p1 - tangent * toUseExtraLen, f.p2 + tangent * toUseExtraLen, inLine->line.p1, inLine->line.p2);
 		}
+		int32 index = points.Add(point);
+		cells.FindOrAdd(packCellKey(x, y)).Add(index);
+		return index;
 	}
-	len = FVector::Dist(inLine->line.p1, inLine->line.p2);
-	if (len < minRoadLen) {
-		delete inLine;
-		return;
-	}
-
-	for (int i = 0; i < lines.Num(); i++) {
-		LinkedLine *pol = lines[i];
-		// check lines
-
-		TArray<FVector> tangents;
-		FVector tangent3 = pol->line.p2 - pol->line.p1;
-		tangent3.Normalize();
-
-		FVector tangent4 = FRotator(0, 90, 0).RotateVector(tangent3);
-
-		tangents.Add(tangent1);
-		tangents.Add(tangent2);
-		tangents.Add(tangent3);
-		tangents.Add(tangent4);
-
-		TArray<FVector> lineVertices2;
-		lineVertices2.Add(pol->line.p1 + tangent4 * width);
-		lineVertices2.Add(pol->line.p1 - tangent4 * width);
-		lineVertices2.Add(pol->line.p2 - tangent4 * width);
-		lineVertices2.Add(pol->line.p2 + tangent4 * width);
-
 
+	float tolerance;
+	TArray<FVector> &points;
+	TMap<uint64, TArray<int32>> cells;
+};
 
-		FVector res = getProperIntersection(pol->line.p1, pol->line.p2, inLine->line.p1, inLine->line.p2);
-			if (res.X != 0.0f) {
-				// is the collision close to the end? if so, old pol is master
-				if (FVector::DistSquared(pol->line.p1, res) + FVector::DistSquared(inLine->line.p2, res) > FVector::DistSquared(pol->line.p2, res) + FVector::DistSquared(inLine->line.p1, res)) {
-					inLine->parent = pol;
-					pol->child = inLine;
-					pol->point = res;
+static float signedArea(const TArray<FVector> &points) {
+	float tot = 0;
+	for (int32 i = 0; i < points.Num(); i++) {
+		const FVector &p1 = points[i];
+		const FVector &p2 = points[(i + 1) % points.Num()];
+		tot += (p1.X * 0.01f) * (p2.Y * 0.01f) - (p2.X * 0.01f) * (p1.Y * 0.01f);
+	}
+	return tot * 0.5f;
+}
 
-				}
-				// so the new line is the master
-				else {	
-					pol->parent = inLine;
-					inLine->child = pol;
-					inLine->point = res;
+static FVector leftNormal(FVector dir) {
+	return FVector(-dir.Y, dir.X, 0);
+}
 
-				}
+// adds the corner where the edge along dir1 turns into the edge along dir2 at v, both moved to the left by their own distance
+static void addOffsetCorner(FVector v, FVector dir1, float d1, FVector dir2, float d2, TArray<FVector> &out) {
+	FVector n1 = leftNormal(dir1);
+	FVector n2 = leftNormal(dir2);
+	float cross = dir1.X * dir2.Y - dir1.Y * dir2.X;
+	float dot = FVector::DotProduct(dir1, dir2);
+	if (FMath::Abs(cross) < 0.001f) {
+		if (dot < 0) {
+			// end of a dead end road, go around it
+			out.Add(v + n1 * d1 + dir1 * d1);
+			out.Add(v + n2 * d2 - dir2 * d2);
+		}
+		else {
+			out.Add(v + n1 * d1);
+			if (FMath::Abs(d1 - d2) > 1.0f)
+				out.Add(v + n2 * d2);
 		}
+		return;
+	}
+	FVector p1 = v + n1 * d1;
+	FVector p2 = v + n2 * d2;
+	FVector2D diff = FVector2D(p2 - p1);
+	float s = (diff ^ FVector2D(dir2)) / cross;
+	FVector corner = p1 + dir1 * s;
+	float maxMiter = 4 * std::max(d1, d2);
+	if (FVector::Dist2D(corner, v) > maxMiter && maxMiter > 0) {
+		// very sharp corner, cut it off instead of letting it reach far away
+		out.Add(p1 + dir1 * std::min(s, maxMiter));
+		out.Add(p2 - dir2 * std::min(s, maxMiter));
+	}
+	else {
+		out.Add(corner);
 	}
-	lines.Add(inLine);
 }
 
-struct PolygonPoint {
-	FPolygon* pol;
-	FVector point;
-};
-
-// get polygons describing the shapes between all of the lines in segments
+// get polygons describing the shapes between all of the lines in segments.
+// the roads are turned into a planar graph: road ends are welded together, free ends are extended by extraLen so they reach roads they almost touch,
+// roads are split where they cross and extensions that lead nowhere are removed. every face of the graph is then a block, moved in from the roads by half their width.
+// extraRoadLen, width and middleOffset only mattered for the line based approach this replaced
 TArray<FMetaPolygon> BaseLibrary::getSurroundingPolygons(TArray<FRoadSegment> &segments, TArray<FRoadSegment> &blocking, float stdWidth, float extraLen, float extraRoadLen, float width, float middleOffset) {
+	TArray<const FRoadSegment*> roads;
+	for (const FRoadSegment &f : segments)
+		roads.Add(&f);
+	if (&blocking != &segments) {
+		for (const FRoadSegment &f : blocking)
+			roads.Add(&f);
+	}
 
-	TArray<LinkedLine*> lines;
+	const float weldDistance = 10.0f;
+	TArray<FVector> vertices;
+	VertexWelder welder(weldDistance, vertices);
 
-	// get coherent polygons
-	for (FRoadSegment f : segments) {
-		// two collision segments for every road
+	TArray<int32> endVertex;
+	endVertex.SetNumUninitialized(roads.Num() * 2);
+	for (int32 i = 0; i < roads.Num(); i++) {
+		endVertex[2 * i] = welder.get(roads[i]->p1);
+		endVertex[2 * i + 1] = welder.get(roads[i]->p2);
+	}
+	TArray<int32> endCount;
+	endCount.SetNumZeroed(vertices.Num());
+	for (int32 v : endVertex)
+		endCount[v]++;
+
+	// ends shared with other roads are connected already, the rest are extended. the original road is between startT and endT
+	struct RoadLine {
+		FVector a;
+		FVector b;
+		float startT;
+		float endT;
+		float offset;
+	};
+	TArray<RoadLine> lines;
+	lines.SetNum(roads.Num());
+	float totalLength = 0;
+	for (int32 i = 0; i < roads.Num(); i++) {
+		const FRoadSegment &f = *roads[i];
 		FVector tangent = f.p2 - f.p1;
+		float len = tangent.Size2D();
+		tangent.Z = 0;
 		tangent.Normalize();
-		FVector extraLength = tangent * extraLen;
-		FVector beginNorm = f.beginTangent;
-		beginNorm.Normalize();
-		FVector sideOffsetBegin = FRotator(0, 90, 0).RotateVector(beginNorm)*(stdWidth/2 * f.width);
-		FVector sideOffsetEnd = FRotator(0, 90, 0).RotateVector(tangent)*(stdWidth / 2 * f.width);
-
-		LinkedLine* left = new LinkedLine();
-		left->line.p2 = f.p1 + sideOffsetBegin - extraLength;
-		left->line.p1 = f.p2 + sideOffsetEnd + extraLength;
-		decidePolygonFate(segments, blocking, left, lines, true, extraRoadLen, width, middleOffset, 0);
-
-
-		if (f.width != 0.0f) {
-			LinkedLine* right = new LinkedLine();
-			right->line.p1 = f.p1 - sideOffsetBegin - extraLength;
-			right->line.p2 = f.p2 - sideOffsetEnd + extraLength;
-			decidePolygonFate(segments, blocking, right, lines, true, extraRoadLen, width, middleOffset, 0);
-		}
+		float extendStart = endCount[endVertex[2 * i]] < 2 ? extraLen : 0;
+		float extendEnd = endCount[endVertex[2 * i + 1]] < 2 ? extraLen : 0;
+		float total = std::max(len + extendStart + extendEnd, 1.0f);
+		lines[i] = { f.p1 - tangent * extendStart, f.p2 + tangent * extendEnd, extendStart / total, (extendStart + len) / total, stdWidth / 2 * f.width };
+		totalLength += total;
 	}
 
-	TSet<LinkedLine*> remaining;
-	remaining.Append(lines);
+	// split points along every road, starting with its ends
+	TArray<TArray<TPair<float, int32>>> splits;
+	splits.SetNum(roads.Num());
+	for (int32 i = 0; i < roads.Num(); i++) {
+		RoadLine &line = lines[i];
+		splits[i].Add(TPair<float, int32>(line.startT, endVertex[2 * i]));
+		splits[i].Add(TPair<float, int32>(line.endT, endVertex[2 * i + 1]));
+		if (line.startT > 0)
+			splits[i].Add(TPair<float, int32>(0.0f, welder.get(line.a)));
+		if (line.endT < 1)
+			splits[i].Add(TPair<float, int32>(1.0f, welder.get(line.b)));
+	}
 
-	TArray<FMetaPolygon> polygons;
-	int count = 0;
-	// build the actual polygons from the linked structures
-	while (remaining.Num() > 0) {
-		TSet<LinkedLine*> taken;
-		UE_LOG(LogTemp, Log, TEXT("remaining: %i"), remaining.Num());
-		auto it = remaining.CreateIterator();
-		LinkedLine* curr = *it;
-		taken.Add(curr);
-		while (curr->parent && remaining.Contains(curr->parent) && !taken.Contains(curr->parent)) {
-			curr = curr->parent;
-			taken.Add(curr);
-		}
-		// now curr is top dog
-		FMetaPolygon f;
-		f.points.Add(curr->line.p1);
-		f.points.Add(curr->point.X != 0.0f ? curr->point: curr->line.p2);
-
-		taken.Empty();
-		taken.Add(curr);
-		remaining.Remove(curr);
-		while (curr->child && !taken.Contains(curr->child)) {
-			curr = curr->child;
-			f.points.Add(curr->point.X != 0.0f ? curr->point : curr->line.p2);
-			remaining.Remove(curr);
-			taken.Add(curr);
-		}
-		if (curr->child && taken.Contains(curr->child)) {
-			// closed polygon since last point continues into first
-			FVector res = getProperIntersection(curr->line.p1, curr->line.p2, curr->child->line.p1, curr->child->line.p2);
-			f.points.RemoveAt(0);
-			f.points.Add(res);
-
-			f.open = false;
-		}
-		else {
-			f.open = true;
+	// only roads sharing grid cells can cross
+	RoadSegmentGrid grid(std::max(roads.Num() > 0 ? totalLength / roads.Num() : 0.0f, 1000.0f));
+	for (int32 i = 0; i < roads.Num(); i++)
+		grid.add(i, lines[i].a, lines[i].b);
+	TArray<int32> nearby;
+	for (int32 i = 0; i < roads.Num(); i++) {
+		RoadLine &line = lines[i];
+		grid.query(line.a, line.b, weldDistance, nearby);
+		for (int32 j : nearby) {
+			if (j <= i)
+				continue;
+			SegmentHit hit = intersection(line.a, line.b, lines[j].a, lines[j].b);
+			if (hit.hit) {
+				int32 v = welder.get(hit.point);
+				splits[i].Add(TPair<float, int32>(hit.t, v));
+				splits[j].Add(TPair<float, int32>(hit.u, v));
+			}
 		}
-		polygons.Add(f);
-
 	}
-	float maxConnect = 5000;
 
-	for (int i = 0; i < polygons.Num(); i++) {
-		FMetaPolygon &f = polygons[i];
-		if (f.open && FVector::Dist(f.points[0], f.points[f.points.Num() - 1]) < maxConnect) {
-			f.open = false;
+	// undirected edges between consecutive split points
+	TArray<int32> edgeFrom;
+	TArray<int32> edgeTo;
+	TArray<float> edgeOffset;
+	TArray<bool> edgeExtension;
+	TSet<uint64> edgeKeys;
+	for (int32 i = 0; i < roads.Num(); i++) {
+		TArray<TPair<float, int32>> &roadSplits = splits[i];
+		roadSplits.Sort([](const TPair<float, int32> &a, const TPair<float, int32> &b) {
+			return a.Key < b.Key;
+		});
+		for (int32 k = 1; k < roadSplits.Num(); k++) {
+			int32 from = roadSplits[k - 1].Value;
+			int32 to = roadSplits[k].Value;
+			if (from == to)
+				continue;
+			uint64 key = packCellKey(std::min(from, to), std::max(from, to));
+			if (edgeKeys.Contains(key))
+				continue;
+			edgeKeys.Add(key);
+			float mid = (roadSplits[k - 1].Key + roadSplits[k].Key) / 2;
+			edgeFrom.Add(from);
+			edgeTo.Add(to);
+			edgeOffset.Add(lines[i].offset);
+			edgeExtension.Add(mid < lines[i].startT || mid > lines[i].endT);
 		}
-		f.checkOrientation();
 	}
 
-	// combine open polygons that are close together
-	TArray<FMetaPolygon> prevOpen;
-	for (int i = 0; i < polygons.Num(); i++) {
-		FMetaPolygon p = polygons[i];
-		if (p.open) {
-			bool added = false;
-			for (FMetaPolygon &p2 : prevOpen) {
-				if (FVector::Dist(p2.points[0], p.points[0]) < maxConnect) {
-					p2.reverse();
-					p2.points.Append(p.points);
-					added = true;
-					break;
-				}
-				else if (FVector::Dist(p2.points[p2.points.Num()-1], p.points[0]) < maxConnect) {
-					p2.points.Append(p.points);
-					added = true;
-					break;
-
-				}
-				else if (FVector::Dist(p2.points[0], p.points[p.points.Num() - 1]) < maxConnect) {
-					p2.reverse();
-					p.reverse();
-					p2.points.Append(p.points);
-					added = true;
-					break;
-
-				}
-				else if (FVector::Dist(p2.points[p2.points.Num() - 1], p.points[p.points.Num() - 1]) < maxConnect) {
-					p.reverse();
-					p2.points.Append(p.points);
-					added = true;
-					break;
-				}
-			}
-			if (!added) {
-				prevOpen.Add(p);
-			}
-			polygons.RemoveAt(i);
-			i--;
+	// remove extensions that didn't reach anything, one piece at a time from the loose end
+	TArray<TArray<int32>> vertexEdges;
+	vertexEdges.SetNum(vertices.Num());
+	TArray<int32> degree;
+	degree.SetNumZeroed(vertices.Num());
+	for (int32 e = 0; e < edgeFrom.Num(); e++) {
+		vertexEdges[edgeFrom[e]].Add(e);
+		vertexEdges[edgeTo[e]].Add(e);
+		degree[edgeFrom[e]]++;
+		degree[edgeTo[e]]++;
+	}
+	TArray<bool> alive;
+	alive.Init(true, edgeFrom.Num());
+	TArray<int32> loose;
+	for (int32 v = 0; v < vertices.Num(); v++) {
+		if (degree[v] == 1)
+			loose.Add(v);
+	}
+	while (loose.Num() > 0) {
+		int32 v = loose.Pop(false);
+		if (degree[v] != 1)
+			continue;
+		for (int32 e : vertexEdges[v]) {
+			if (!alive[e] || !edgeExtension[e])
+				continue;
+			alive[e] = false;
+			degree[edgeFrom[e]]--;
+			degree[edgeTo[e]]--;
+			int32 other = edgeFrom[e] == v ? edgeTo[e] : edgeFrom[e];
+			if (degree[other] == 1)
+				loose.Add(other);
+			break;
 		}
+	}
 
+	// half edge 2e goes from edgeFrom to edgeTo, 2e + 1 goes back. outgoing half edges of every vertex are sorted by angle
+	TArray<TArray<int32>> outgoing;
+	outgoing.SetNum(vertices.Num());
+	for (int32 e = 0; e < edgeFrom.Num(); e++) {
+		if (!alive[e])
+			continue;
+		outgoing[edgeFrom[e]].Add(2 * e);
+		outgoing[edgeTo[e]].Add(2 * e + 1);
+	}
+	auto heFrom = [&](int32 h) { return h % 2 == 0 ? edgeFrom[h / 2] : edgeTo[h / 2]; };
+	auto heTo = [&](int32 h) { return h % 2 == 0 ? edgeTo[h / 2] : edgeFrom[h / 2]; };
+	TArray<int32> outIndex;
+	outIndex.SetNumUninitialized(edgeFrom.Num() * 2);
+	for (int32 v = 0; v < vertices.Num(); v++) {
+		TArray<int32> &out = outgoing[v];
+		out.Sort([&](int32 h1, int32 h2) {
+			FVector d1 = vertices[heTo(h1)] - vertices[v];
+			FVector d2 = vertices[heTo(h2)] - vertices[v];
+			return FMath::Atan2(d1.Y, d1.X) < FMath::Atan2(d2.Y, d2.X);
+		});
+		for (int32 k = 0; k < out.Num(); k++)
+			outIndex[out[k]] = k;
 	}
-	polygons.Append(prevOpen);
-	// remove redundant points, zip together open polygons where end and beginning are really close together, and check orientation, and remove very pointy edges
-	for (int i = 0; i < polygons.Num(); i++) {
-		FMetaPolygon &f = polygons[i];
-		if (f.open && FVector::Dist(f.points[0], f.points[f.points.Num() - 1]) < maxConnect) {
-			f.open = false;
-		}
 
-		f.clipEdges(-0.96f);
-		if (f.points.Num() < 3) {
-			polygons.RemoveAt(i);
-			i--;
+	// walk the faces, turning as far right as possible at every vertex keeps the face on the left
+	TArray<bool> visited;
+	visited.Init(false, edgeFrom.Num() * 2);
+	TArray<TArray<int32>> faces;
+	for (int32 start = 0; start < edgeFrom.Num() * 2; start++) {
+		if (!alive[start / 2] || visited[start])
+			continue;
+		TArray<int32> face;
+		int32 h = start;
+		while (!visited[h]) {
+			visited[h] = true;
+			face.Add(h);
+			TArray<int32> &out = outgoing[heTo(h)];
+			int32 twin = h ^ 1;
+			h = out[(outIndex[twin] - 1 + out.Num()) % out.Num()];
 		}
+		if (h == start)
+			faces.Add(MoveTemp(face));
 	}
 
+	// every face is turned into a block on its own, so they are done on all threads
+	TArray<FMetaPolygon> polygons;
+	polygons.SetNum(faces.Num());
+	TArray<bool> keep;
+	keep.Init(false, faces.Num());
+	ParallelFor(faces.Num(), [&](int32 i) {
+		const TArray<int32> &face = faces[i];
+		TArray<FVector> facePoints;
+		facePoints.Reserve(face.Num());
+		for (int32 h : face)
+			facePoints.Add(vertices[heFrom(h)]);
+		// the outside of the network goes around the other way
+		if (signedArea(facePoints) <= 0)
+			return;
 
-	for (LinkedLine* l : lines) {
-		delete (l);
+		TArray<FVector> offsetPoints;
+		offsetPoints.Reserve(face.Num() + 4);
+		for (int32 k = 0; k < face.Num(); k++) {
+			int32 h1 = face[k];
+			int32 h2 = face[(k + 1) % face.Num()];
+			FVector v = vertices[heTo(h1)];
+			FVector dir1 = v - vertices[heFrom(h1)];
+			FVector dir2 = vertices[heTo(h2)] - v;
+			dir1.Z = 0;
+			dir2.Z = 0;
+			dir1.Normalize();
+			dir2.Normalize();
+			addOffsetCorner(v, dir1, edgeOffset[h1 / 2], dir2, edgeOffset[h2 / 2], offsetPoints);
+		}
+		// blocks narrower than the roads around them turn inside out
+		if (signedArea(offsetPoints) <= 0)
+			return;
+
+		FMetaPolygon &f = polygons[i];
+		f.points = MoveTemp(offsetPoints);
+		f.open = false;
+		f.checkOrientation();
+		FPolygon2D clipped = f.to2D();
+		clipped.clipEdges(-0.96f);
+		f.set2D(clipped);
+		keep[i] = f.points.Num() >= 3;
+	});
+
+	// compact in place, keeping the order the faces were found in
+	int32 kept = 0;
+	for (int32 i = 0; i < polygons.Num(); i++) {
+		if (!keep[i])
+			continue;
+		if (kept != i)
+			polygons[kept] = MoveTemp(polygons[i]);
+		kept++;
 	}
+	polygons.SetNum(kept);
 	return polygons;
-
-
 }
 
 TArray<FMaterialPolygon> getSidesOfPolygon(FPolygon p, PolygonType type, float width) {
@@ -723,11 +936,11 @@ FPolygon getPolygon(FRotator rot, FVector pos, FString name, TMap<FString, UHier
 	return pol;
 }
 
-TArray<FMeshInfo> placeRandomly(FPolygon pol, TArray<FPolygon> &blocking, int num, FString name, bool useRealPolygon , const TMap<FString, UHierarchicalInstancedStaticMeshComponent*> *map) {
+TArray<FMeshInfo> placeRandomly(FPolygon pol, TArray<FPolygon> &blocking, int num, FString name, bool useRealPolygon , const TMap<FString, UHierarchicalInstancedStaticMeshComponent*> *map, FRandomStream &stream) {
 	TArray<FMeshInfo> meshes;
 	int hits = 0;
 	for (int i = 0; i < num; i++) {
-		FVector point = pol.getRandomPoint(true, 50);
+		FVector point = pol.getRandomPoint(true, 50, stream);
 		if (point.X != 0.0f) {
 			hits++;
 			FPolygon temp;
@@ -748,16 +961,16 @@ TArray<FMeshInfo> placeRandomly(FPolygon pol, TArray<FPolygon> &blocking, int nu
 	return meshes;
 }
 
-TArray<FMeshInfo> attemptPlaceClusterAlongSide(FPolygon pol, TArray<FPolygon> &blocking, int num, float distBetween, FString name, float offset, bool useRealPolygon, const TMap<FString, UHierarchicalInstancedStaticMeshComponent*> *map, bool wholeSide) {
+TArray<FMeshInfo> attemptPlaceClusterAlongSide(FPolygon pol, TArray<FPolygon> &blocking, int num, float distBetween, FString name, float offset, bool useRealPolygon, const TMap<FString, UHierarchicalInstancedStaticMeshComponent*> *map, bool wholeSide, FRandomStream &stream) {
 	TArray<FMeshInfo> meshes;
-	int place = FMath::RandRange(1, pol.points.Num());
-	FVector posStart = wholeSide ? pol[place - 1] : getRandomPointOnLine(pol[place - 1], pol[place%pol.points.Num()], 100);
-	FVector tan = pol[place%pol.points.Num()] - pol[place - 1];
+	int place = stream.RandRange(1, pol.points.Num());
+	FVector posStart = wholeSide ? pol.points[place - 1] : getRandomPointOnLine(pol.points[place - 1], pol.points[place%pol.points.Num()], 100, stream);
+	FVector tan = pol.points[place%pol.points.Num()] - pol.points[place - 1];
 	tan.Normalize();
-	FVector finRot = getNormal(pol[place - 1], pol[place%pol.points.Num()], false);
+	FVector finRot = getNormal(pol.points[place - 1], pol.points[place%pol.points.Num()], false);
 	finRot.Normalize();
 	///FRotator finRot = //tan.Rotation() + FRotator(0, 90, 0);// +FRotator(0, 180, 0);
-	float distToEnd = FVector::Dist(posStart, pol[place%pol.points.Num()]);
+	float distToEnd = FVector::Dist(posStart, pol.points[place%pol.points.Num()]);
 	for (int i = 0; i < num; i++) {
 		if (i * distBetween > distToEnd)
 			break;
@@ -790,7 +1003,7 @@ void attemptPlaceCenter(FPolygon &pol, TArray<FPolygon> &placed, TArray<FMeshInf
 	}
 }
 
-void FSimplePlot::decorate(TArray<FPolygon> blocking, TMap<FString, UHierarchicalInstancedStaticMeshComponent*> map) {
+void FSimplePlot::decorate(TArray<FPolygon> blocking, TMap<FString, UHierarchicalInstancedStaticMeshComponent*> map, FRandomStream &stream) {
 	blocking.Append(obstacles);
 	float area = pol.getArea();
 	switch (type) {
@@ -805,18 +1018,18 @@ void FSimplePlot::decorate(TArray<FPolygon> blocking, TMap<FString, UHierarchica
 			bushAreaRatio *= 15;
 			grassRatio *= 30;
 		}
-		meshes.Append(placeRandomly(pol, blocking, treeAreaRatio*area, "tree1"));
-		meshes.Append(placeRandomly(pol, blocking, treeAreaRatio*area, "tree2"));
-		meshes.Append(placeRandomly(pol, blocking, bushAreaRatio*area, "bush1"));
-		meshes.Append(placeRandomly(pol, blocking, bushAreaRatio*area, "bush2"));
-		meshes.Append(placeRandomly(pol, blocking, grassRatio*area, "grass"));
+		meshes.Append(placeRandomly(pol, blocking, treeAreaRatio*area, "tree1", false, nullptr, stream));
+		meshes.Append(placeRandomly(pol, blocking, treeAreaRatio*area, "tree2", false, nullptr, stream));
+		meshes.Append(placeRandomly(pol, blocking, bushAreaRatio*area, "bush1", false, nullptr, stream));
+		meshes.Append(placeRandomly(pol, blocking, bushAreaRatio*area, "bush2", false, nullptr, stream));
+		meshes.Append(placeRandomly(pol, blocking, grassRatio*area, "grass", false, nullptr, stream));
 		break;
 	}
 	case SimplePlotType::asphalt: {
-		if (baseLibraryStream.FRand() < 0.3) {
-			meshes.Append(attemptPlaceClusterAlongSide(pol, blocking, FMath::RandRange(1, 5), 0, "trash_box", 150 , true, &map));
-		} if (baseLibraryStream.FRand() < 0.3) {
-			meshes.Append(attemptPlaceClusterAlongSide(pol, blocking, 500, 410, "fence", 150, true, &map, true));
+		if (stream.FRand() < 0.3) {
+			meshes.Append(attemptPlaceClusterAlongSide(pol, blocking, stream.RandRange(1, 5), 0, "trash_box", 150 , true, &map, false, stream));
+		} if (stream.FRand() < 0.3) {
+			meshes.Append(attemptPlaceClusterAlongSide(pol, blocking, 500, 410, "fence", 150, true, &map, true, stream));
 
 		}
 
@@ -78,21 +78,48 @@ enum class PolygonType : uint8
 	asphalt UMETA(DisplayName = "Road Material")
 };
 
-void getMinMax(float &min, float &max, FVector tangent, TArray<FVector> points);
+void getMinMax(float &min, float &max, FVector tangent, const TArray<FVector> &points);
 
-FVector intersection(FPolygon &p1, TArray<FPolygon> &p2);
-FVector intersection(FPolygon &p1, FPolygon &p2);
-FVector intersection(FVector p1, FVector p2, FVector p3, FVector p4);
-FVector intersection(FVector p1, FVector p2, FPolygon p);
+// points of a polygon in X and Y, kept in separate arrays for the separating axis tests. the arrays are padded to a multiple of four
+// by repeating the last point so they can be projected four at a time, polygons of up to 32 points don't allocate
+struct SATPolygon {
+	explicit SATPolygon(const TArray<FVector> &points);
+	// smallest and largest projection of the points onto the axis (ax, ay), min is larger than max if there are no points
+	void project(float ax, float ay, float &min, float &max) const;
+
+	TArray<float, TInlineAllocator<32>> x;
+	TArray<float, TInlineAllocator<32>> y;
+};
+
+// true if the projections of the polygons onto the axis overlap by more than leniency
+bool testSATAxis(const SATPolygon &p1, const SATPolygon &p2, float ax, float ay, float leniency);
+
+// result of intersecting segments. t and u run from 0 at the start to 1 at the end of the first and the second segment,
+// index is the edge that was hit when testing against a polyline
+struct SegmentHit {
+	bool hit = false;
+	float t = 0.0f;
+	float u = 0.0f;
+	FVector point = FVector(0.0f, 0.0f, 0.0f);
+	int32 index = INDEX_NONE;
+};
+
+// segments ending within epsilon of each other (as a fraction of their length) still hit, parallel segments never do
+SegmentHit intersection(FVector p1, FVector p2, FVector p3, FVector p4, float epsilon = 0.0f);
+// tests p1-p2 against every edge of a polyline, edge i going from points[i - 1] to points[i % num] like in the polygons.
+// returns the hit closest to p1 if closest is set and the first edge hit otherwise, the edge skip is never hit
+SegmentHit intersection(FVector p1, FVector p2, const FVector *points, int32 num, bool closed, bool closest = false, int32 skip = INDEX_NONE, float epsilon = 0.0f);
+SegmentHit intersection(FVector p1, FVector p2, const FPolygon &p);
+SegmentHit intersection(FPolygon &p1, FPolygon &p2);
+SegmentHit intersection(FPolygon &p1, TArray<FPolygon> &p2);
 bool selfIntersection(FPolygon &p1);
 bool testCollision(FPolygon &, TArray<FPolygon> &, float leniency, FPolygon &);
 bool testCollision(FPolygon &, FPolygon &, float leniency);
-bool testCollision(TArray<FVector> tangents, TArray<FVector> vertices1, TArray<FVector> vertices2, float collisionLeniency);
+bool testCollision(const TArray<FVector> &tangents, const TArray<FVector> &vertices1, const TArray<FVector> &vertices2, float collisionLeniency);
 FVector NearestPointOnLine(FVector linePnt, FVector lineDir, FVector pnt);
 TArray<FMaterialPolygon> getSidesOfPolygon(FPolygon p, PolygonType type, float width);
 TArray <FMaterialPolygon> fillOutPolygon(FMaterialPolygon &p);
 TArray<FMaterialPolygon> fillOutPolygons(TArray<FMaterialPolygon> &first);
-FVector intersection(FVector p1, FVector p2, FVector p3, FVector p4);
 TArray<FPolygon> getBlockingEntrances(TArray<FVector> points, TSet<int32> entrances, TMap<int32, FVector> specificEntrances, float entranceWidth, float blockingLength);
 
 FPolygon getEntranceHole(FVector p1, FVector p2, float floorHeight, float doorHeight, float doorWidth, FVector doorPos);
@@ -104,7 +131,10 @@ const float simplePlotGroundOffset = 30;
 const bool proceduralMeshesCollision = true;
 
 static FVector getNormal(FVector p1, FVector p2, bool right) {
-	return FRotator(0, right ? 90 : 270, 0).RotateVector(p2 - p1);
+	// same as FRotator::RotateVector, but the rotation matrices are only made once
+	static const FRotationMatrix rightRotation(FRotator(0, 90, 0));
+	static const FRotationMatrix leftRotation(FRotator(0, 270, 0));
+	return (right ? rightRotation : leftRotation).TransformVector(p2 - p1);
 }
 
 FVector fitPolygonNextToPolygon(FPolygon &toFitAround, FPolygon &toMove, int place, FRotator offsetRot);
@@ -118,6 +148,237 @@ static FVector middle(FVector p1, FVector p2) {
 	return (p2 + p1) / 2;
 }
 
+// removes every point closer than 10 to the point kept before it, then the first points while they are close to the last one.
+// gives the same result as calling decreaseEdges until it returns false, but moves every point at most once
+template <typename T>
+static void removeClosePoints(TArray<T> &points) {
+	int32 num = points.Num();
+	if (num == 0)
+		return;
+	int32 kept = 1;
+	for (int32 i = 1; i < num; i++) {
+		if (T::DistSquared(points[kept - 1], points[i]) >= 100.0f)
+			points[kept++] = points[i];
+	}
+	// a single point left is close to itself and goes too, like it does in decreaseEdges
+	int32 first = 0;
+	while (first < kept && T::DistSquared(points[kept - 1], points[first]) < 100.0f)
+		first++;
+	points.SetNum(kept, false);
+	points.RemoveAt(0, first, false);
+}
+
+// removes the point after every corner sharper than maxDot, checking the corner again with its new next point, as long as more than 3 points are left.
+// the last corner can only cut off the first point once. gives the same result as removing them one at a time in order, but moves every point at most once
+template <typename T>
+static void removeSharpCorners(TArray<T> &points, float maxDot) {
+	int32 num = points.Num();
+	if (num <= 3)
+		return;
+	// points[0, kept) are done, points[next, num) are not looked at yet
+	int32 kept = 2;
+	int32 next = 2;
+	int32 first = 0;
+	while (true) {
+		bool wrapped = next == num;
+		T tan1 = points[kept - 1] - points[kept - 2];
+		T tan2 = (wrapped ? points[first] : points[next]) - points[kept - 1];
+		tan1.Normalize();
+		tan2.Normalize();
+		if (T::DotProduct(tan1, tan2) < maxDot && kept - first + num - next > 3) {
+			if (wrapped) {
+				first++;
+				break;
+			}
+			next++;
+		}
+		else if (!wrapped) {
+			points[kept++] = points[next++];
+		}
+		else {
+			break;
+		}
+	}
+	points.SetNum(kept, false);
+	points.RemoveAt(0, first, false);
+}
+
+// a polygon in the plane, for the generation steps that only look at X and Y. up to eight points are stored inline so house footprints
+// don't allocate, and turning a vector by 90 degrees swaps its components instead of building a rotation matrix
+struct FPolygon2D {
+	TArray<FVector2D, TInlineAllocator<8>> points;
+	// height of the polygon, used for points that didn't exist in 3D before
+	float z = 0.0f;
+
+	FPolygon2D() {}
+
+	explicit FPolygon2D(const TArray<FVector> &in) {
+		points.SetNumUninitialized(in.Num());
+		for (int32 i = 0; i < in.Num(); i++)
+			points[i] = FVector2D(in[i].X, in[i].Y);
+		z = in.Num() > 0 ? in[0].Z : 0.0f;
+	}
+
+	// writes the points back in 3D, if the number of points didn't change every point keeps its own height
+	void toPoints(TArray<FVector> &out) const {
+		bool keepHeights = out.Num() == points.Num();
+		out.SetNum(points.Num());
+		for (int32 i = 0; i < points.Num(); i++)
+			out[i] = FVector(points[i].X, points[i].Y, keepHeights ? out[i].Z : z);
+	}
+
+	FVector to3D(FVector2D point) const {
+		return FVector(point.X, point.Y, z);
+	}
+
+	// same as FRotator(0, 90, 0).RotateVector and FRotator(0, 270, 0).RotateVector
+	static FVector2D rotate90(FVector2D v) {
+		return FVector2D(-v.Y, v.X);
+	}
+
+	static FVector2D rotate270(FVector2D v) {
+		return FVector2D(v.Y, -v.X);
+	}
+
+	// same as intersection() for two segments, t is how far along p1-p2 the hit is
+	static bool segmentHit(FVector2D p1, FVector2D p2, FVector2D p3, FVector2D p4, float &t) {
+		FVector2D s1 = p2 - p1;
+		FVector2D s2 = p4 - p3;
+		float denom = -s2.X * s1.Y + s1.X * s2.Y;
+		if (denom * denom <= 1e-12f * s1.SizeSquared() * s2.SizeSquared())
+			return false;
+		float s = (-s1.Y * (p1.X - p3.X) + s1.X * (p1.Y - p3.Y)) / denom;
+		t = (s2.X * (p1.Y - p3.Y) - s2.Y * (p1.X - p3.X)) / denom;
+		return s >= 0 && s <= 1 && t >= 0 && t <= 1;
+	}
+
+	bool getIsClockwise() const {
+		float tot = 0;
+		for (int32 i = 1; i < points.Num() + 1; i++) {
+			tot += (points[i - 1].X*0.01 * points[i%points.Num()].Y*0.01 - points[i%points.Num()].X*0.01 * points[i - 1].Y*0.01);
+		}
+		return tot > 0;
+	}
+
+	double getArea() const {
+		double tot = 0;
+		for (int32 i = 0; i < points.Num(); i++) {
+			tot += 0.0001*(double(points[i].X) * points[(i + 1) % points.Num()].Y);
+			tot -= 0.0001*(double(points[i].Y) * points[(i + 1) % points.Num()].X);
+		}
+		tot *= 0.5;
+		return std::abs(tot);
+	}
+
+	// middle of the sides weighted by their length, like FPolygon::getCenter
+	FVector2D getCenter() const {
+		FVector2D center(0, 0);
+		double totLen = 0;
+		for (int32 i = 1; i < points.Num() + 1; i++) {
+			FVector2D side = points[i%points.Num()] - points[i - 1];
+			float len = side.Size();
+			center += (side / 2 + points[i - 1]) * len;
+			totLen += len;
+		}
+		return center / totLen;
+	}
+
+	FVector2D getPointDirection(int32 place, bool left) const {
+		int32 prev = place == 0 ? points.Num() - 1 : place - 1;
+		FVector2D side1 = points[prev] - points[place];
+		FVector2D side2 = points[place] - points[(place + 1) % points.Num()];
+		FVector2D dir1 = left ? rotate90(side1) : rotate270(side1);
+		FVector2D dir2 = left ? rotate90(side2) : rotate270(side2);
+		dir1.Normalize();
+		dir2.Normalize();
+		FVector2D totDir = dir1 + dir2;
+		totDir.Normalize();
+		return totDir;
+	}
+
+	void symmetricShrink(float length, bool left) {
+		for (int32 i = 0; i < points.Num(); i++) {
+			points[i] += getPointDirection(i, left)*length;
+		}
+	}
+
+	// merges points closer than 10 to each other, one at a time like FPolygon::decreaseEdges
+	bool decreaseEdges() {
+		for (int32 i = 1; i < points.Num() + 1; i++) {
+			if (FVector2D::DistSquared(points[i - 1], points[i%points.Num()]) < 100.0f) {
+				points.RemoveAt(i%points.Num());
+				return true;
+			}
+		}
+		return false;
+	}
+
+	void clipEdges(float maxDot) {
+		removeClosePoints(points);
+		removeSharpCorners(points, maxDot);
+	}
+
+	bool getSplitCorrespondingPoint(int32 begin, FVector2D point, FVector2D inNormal, int32 &split, FVector2D &p2) const {
+		float closest = 10000000.0f;
+		bool found = false;
+		FVector2D end = point + inNormal * 100000;
+		for (int32 i = 1; i < points.Num() + 1; i++) {
+			float t;
+			if (i == begin || !segmentHit(point, end, points[i - 1], points[i%points.Num()], t))
+				continue;
+			FVector2D curr = point + (end - point) * t;
+			float dist = FVector2D::Distance(curr, point);
+			if (dist < closest) {
+				closest = dist;
+				split = i;
+				p2 = curr;
+				found = true;
+			}
+		}
+		return found;
+	}
+
+	// same split as FPolygon::getSplitProposal, the points in the result are placed at the height of the polygon
+	SplitStruct getSplitProposal(bool isClockwise, float approxRatio, int32 preDeterminedNum = -1) const {
+		const SplitStruct failed{ 0, 0, FVector(0.0f, 0.0f, 0.0f), FVector(0.0f, 0.0f, 0.0f) };
+		if (points.Num() < 3)
+			return failed;
+		int32 longest = -1;
+		if (preDeterminedNum > -1) {
+			longest = preDeterminedNum;
+		}
+		else {
+			float longestLen = 0.0f;
+			for (int32 i = 1; i < points.Num() + 1; i++) {
+				float dist = FVector2D::DistSquared(points[i%points.Num()], points[i - 1]);
+				if (dist > longestLen) {
+					longestLen = dist;
+					longest = i;
+				}
+			}
+		}
+		if (longest == -1)
+			return failed;
+
+		FVector2D side = points[longest%points.Num()] - points[longest - 1];
+		FVector2D curr = side;
+		curr.Normalize();
+		FVector2D middle = side * approxRatio + points[longest - 1];
+		FVector2D tangent = isClockwise ? rotate90(curr) : rotate270(curr);
+		tangent.Normalize();
+
+		int32 split = 0;
+		FVector2D p2;
+		if (!getSplitCorrespondingPoint(longest, middle, tangent, split, p2))
+			return failed;
+
+		// they are expected to come out in order
+		if (longest > split)
+			return SplitStruct{ split, longest, to3D(p2), to3D(middle) };
+		return SplitStruct{ longest, split, to3D(middle), to3D(p2) };
+	}
+};
+
 USTRUCT(BlueprintType)
 struct FPolygon
 {
@@ -128,6 +389,37 @@ struct FPolygon
 	UPROPERTY(BlueprintReadWrite)
 		TArray<FVector> points;
 
+	// tests between polygons skip the edge by edge work when the bounding boxes are apart, can be turned off to compare
+	static bool useBoundsEarlyOut;
+
+	// bounding box in X and Y, computed when first needed. every change to the points has to go through
+	// invalidateBounds: the methods here call it, code writing to points directly has to call it itself.
+	// the point count is only compared as a safety net for code that adds or removes points and forgets
+	const FBox2D& getBounds() const {
+		if (!boundsCache.valid || boundsCache.num != points.Num()) {
+			boundsCache.box = FBox2D(ForceInit);
+			for (const FVector &point : points)
+				boundsCache.box += FVector2D(point);
+			boundsCache.num = points.Num();
+			boundsCache.valid = true;
+		}
+		return boundsCache.box;
+	}
+
+	void invalidateBounds() {
+		boundsCache.valid = false;
+	}
+
+	FPolygon2D to2D() const {
+		return FPolygon2D(points);
+	}
+
+	// takes the points of a polygon worked on in 2D
+	void set2D(const FPolygon2D &p) {
+		p.toPoints(points);
+		invalidateBounds();
+	}
+
 	bool getIsClockwise() {
 		float tot = 0;
 		FVector first = points[0];
@@ -138,12 +430,20 @@ struct FPolygon
 		return tot > 0;
 	}
 
+	// the point may be written through the reference, so the bounds can't be trusted after this
 	FVector& operator[] (int index) {
+		invalidateBounds();
+		return points[index];
+	}
+
+	// reading a point leaves the bounds alone
+	const FVector& operator[] (int index) const {
 		return points[index];
 	}
 
 	void operator+= (FVector toAdd) {
 		points.Add(toAdd);
+		invalidateBounds();
 	}
 
 	FVector getCenter() {
@@ -167,8 +467,7 @@ struct FPolygon
 		FVector pointNormal = FRotator(0, left ? 90 : 270, 0).RotateVector(tangent);
 		int a;
 		FVector target;
-		getSplitCorrespondingPoint(place, beginPlace, pointNormal, a, target);
-		if (target.X == 0.0f || FVector::Dist(beginPlace, target) < minDist * 2)
+		if (!getSplitCorrespondingPoint(place, beginPlace, pointNormal, a, target) || FVector::Dist(beginPlace, target) < minDist * 2)
 			return FVector(0, 0, 0);
 		FVector point = stream.FRandRange(minDist, FVector::Dist(beginPlace, target) - minDist) * pointNormal + beginPlace;
 		return point;
@@ -191,6 +490,7 @@ struct FPolygon
 		for (FVector &f : points) {
 			f += offset;
 		}
+		invalidateBounds();
 	};
 
 	void rotate(FRotator rotation) {
@@ -198,32 +498,14 @@ struct FPolygon
 		for (FVector &f : points) {
 			f = rotation.RotateVector(f - center) + center;
 		}
+		invalidateBounds();
 	}
 
 	// removes corners that stick out in an ugly way
 	void clipEdges(float maxDot) {
-		//bool changed = true;
-		while (decreaseEdges()) {
-			continue;
-		}
-			//changed = decreaseEdges();
-			//if (changed)
-			//	continue;
-		for (int i = 1; i < points.Num(); i++) {
-			FVector tan1 = points[i] - points[i - 1];
-			FVector tan2 = points[(i + 1) % points.Num()] - points[i];
-			tan1.Normalize();
-			tan2.Normalize();
-			float dist = FVector::DotProduct(tan1, tan2);
-			if (dist < maxDot && points.Num() > 3) {
-				points.RemoveAt((i + 1) % points.Num());
-				//changed = true;
-				i--;
-				//break;
-			}
-
-		}
-		//}
+		invalidateBounds();
+		removeClosePoints(points);
+		removeSharpCorners(points, maxDot);
 
 
 		// untangle
@@ -259,10 +541,10 @@ struct FPolygon
 
 	// this method merges polygon sides when possible, and combines points
 	bool decreaseEdges() {
-		float distDiffAllowed = 10;
 		for (int i = 1; i < points.Num() + 1; i++) {
-			if (FVector::Dist(points[i - 1], points[i%points.Num()]) < distDiffAllowed) {
+			if (FVector::DistSquared(points[i - 1], points[i%points.Num()]) < 100.0f) {
 				points.RemoveAt(i%points.Num());
+				invalidateBounds();
 				return true;
 			}
 		}
@@ -282,22 +564,16 @@ struct FPolygon
 	}
 
 	/*
-	This function finds the intersection point of the splitting line from point in direction inNormal, placing the index of the line in split and point in p2
+	This function finds the intersection point of the splitting line from point in direction inNormal, placing the index of the line in split and point in p2.
+	returns false and leaves split and p2 as they were if the line doesn't hit any other side
 	*/
-	void getSplitCorrespondingPoint(int begin, FVector point, FVector inNormal, int &split, FVector &p2) {
-		float closest = 10000000.0f;
-		for (int i = 1; i < points.Num() + 1; i++) {
-			if (i == begin) {
-				continue;
-			}
-			FVector curr = intersection(point, point + inNormal * 100000, points[i - 1], points[i%points.Num()]);
-			if (curr.X != 0.0f && FVector::Dist(curr, point) < closest) {
-				closest = FVector::Dist(curr, point);
-				split = i;
-				p2 = curr;
-			}
-		}
-
+	bool getSplitCorrespondingPoint(int begin, FVector point, FVector inNormal, int &split, FVector &p2) const {
+		SegmentHit hit = intersection(point, point + inNormal * 100000, points.GetData(), points.Num(), true, true, begin);
+		if (!hit.hit || FVector::Dist(hit.point, point) >= 10000000.0f)
+			return false;
+		split = hit.index;
+		p2 = hit.point;
+		return true;
 	}
 
 	SplitStruct getSplitProposal(bool isClockwise, float approxRatio, int preDeterminedNum = -1) {
@@ -334,9 +610,7 @@ struct FPolygon
 		FVector tangent = FRotator(0, isClockwise ? 90 : 270, 0).RotateVector(curr);
 		tangent.Normalize();
 
-		getSplitCorrespondingPoint(longest, middle, tangent, split, p2);
-
-		if (p2.X == 0.0f || p1.X == 0.0f) {
+		if (!getSplitCorrespondingPoint(longest, middle, tangent, split, p2)) {
 			UE_LOG(LogTemp, Warning, TEXT("UNABLE TO SPLIT, NO CORRESPONDING SPLIT POINT FOR POLYGON"));
 			// cant split, no target, this shouldn't happen unless the polygons are poorly constructed
 			return SplitStruct{ 0, 0, FVector(0.0f, 0.0f, 0.0f), FVector(0.0f, 0.0f, 0.0f) };
@@ -379,6 +653,7 @@ struct FPolygon
 		for (int i = 0; i < points.Num(); i++) {
 			points[i] += getPointDirection(i, left)*length;
 		}
+		invalidateBounds();
 	}
 
 
@@ -390,6 +665,22 @@ struct FPolygon
 		return getNormal(points[1], points[0], true);
 	}
 
+private:
+	// a copied polygon starts without bounds and computes its own, so nothing stale is carried over
+	struct BoundsCache {
+		FBox2D box;
+		int32 num = 0;
+		bool valid = false;
+
+		BoundsCache() {}
+		BoundsCache(const BoundsCache &) {}
+		BoundsCache& operator=(const BoundsCache &) {
+			valid = false;
+			return *this;
+		}
+	};
+
+	mutable BoundsCache boundsCache;
 };
 
 
@@ -471,8 +762,8 @@ enum class SimplePlotType : uint8
 
 
 
-TArray<FMeshInfo> placeRandomly(FPolygon pol, TArray<FPolygon> &blocking, int num, FString name, bool useRealPolygon = false, const TMap<FString, UHierarchicalInstancedStaticMeshComponent*> *map = nullptr);
-TArray<FMeshInfo> attemptPlaceClusterAlongSide(FPolygon pol, TArray<FPolygon> &blocking, int num, float distBetween, FString name, float offset, bool useRealPolygon = false, const TMap<FString, UHierarchicalInstancedStaticMeshComponent*> *map = nullptr, bool wholeSide = false);
+TArray<FMeshInfo> placeRandomly(FPolygon pol, TArray<FPolygon> &blocking, int num, FString name, bool useRealPolygon = false, const TMap<FString, UHierarchicalInstancedStaticMeshComponent*> *map = nullptr, FRandomStream &stream = baseLibraryStream);
+TArray<FMeshInfo> attemptPlaceClusterAlongSide(FPolygon pol, TArray<FPolygon> &blocking, int num, float distBetween, FString name, float offset, bool useRealPolygon = false, const TMap<FString, UHierarchicalInstancedStaticMeshComponent*> *map = nullptr, bool wholeSide = false, FRandomStream &stream = baseLibraryStream);
 void attemptPlaceCenter(FPolygon &pol, TArray<FPolygon> &placed, TArray<FMeshInfo> &meshes, FString string, FRotator offsetRot, FVector offsetPos, TMap<FString, UHierarchicalInstancedStaticMeshComponent*> map);
 void placeRows(FPolygon *r2, TArray<FPolygon> &placed, TArray<FMeshInfo> &meshes, FRotator offsetRot, FString name, float vertDens, float horDens, TMap<FString, UHierarchicalInstancedStaticMeshComponent*> map, bool left = false, int numToPlace = -1);
 FMeshInfo getEntranceMesh(FVector p1, FVector p2, FVector doorPos);
@@ -501,12 +792,21 @@ struct FSimplePlot {
 	}
 
 
-	void decorate(TMap<FString, UHierarchicalInstancedStaticMeshComponent*> map) {
-		decorate(obstacles, map);
+	void decorate(TMap<FString, UHierarchicalInstancedStaticMeshComponent*> map, FRandomStream &stream = baseLibraryStream) {
+		decorate(obstacles, map, stream);
 	}
 
 
-	void decorate(TArray<FPolygon> blocking, TMap<FString, UHierarchicalInstancedStaticMeshComponent*> map);
+	// placement is drawn from the stream, plots decorated at the same time need their own streams
+	void decorate(TArray<FPolygon> blocking, TMap<FString, UHierarchicalInstancedStaticMeshComponent*> map, FRandomStream &stream = baseLibraryStream);
+
+	void offset(FVector offset) {
+		pol.offset(offset);
+		for (FPolygon &p : obstacles)
+			p.offset(offset);
+		for (FMeshInfo &f : meshes)
+			f.transform.SetTranslation(f.transform.GetTranslation() + offset);
+	}
 
 };
 
@@ -525,6 +825,18 @@ struct FTextStruct {
 
 };
 
+// polygons of a floor that repeats in a house, built once and shown at every height in offsets
+USTRUCT(BlueprintType)
+struct FFloorChunk {
+	GENERATED_USTRUCT_BODY();
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+		TArray<FMaterialPolygon> pols;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+		TArray<float> offsets;
+};
+
 USTRUCT(BlueprintType)
 struct FHouseInfo {
 	GENERATED_USTRUCT_BODY();
@@ -535,6 +847,14 @@ struct FHouseInfo {
 	UPROPERTY(EditAnywhere, BlueprintReadWrite)
 		TArray<FSimplePlot> remainingPlots;
 
+	// floors that aren't part of the polygons in roomInfo, the meshes placed on them are
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+		TArray<FFloorChunk> floors;
+
+	// everything above is relative to this point, it's only not zero when the house was generated in local coordinates
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+		FVector origin = FVector(0, 0, 0);
+
 };
 
 
@@ -989,6 +1309,7 @@ struct FRoomPolygon : public FPolygon
 		points.RemoveAt(p.min, p.max - p.min);
 		points.EmplaceAt(p.min, p.p1);
 		points.EmplaceAt(p.min + 1, p.p2);
+		invalidateBounds();
 
 		int entrancesThis = getTotalConnections();
 		int entrancesNewP = newP->getTotalConnections();
@@ -1212,8 +1533,9 @@ struct FRoomPolygon : public FPolygon
 	//}
 
 	FRoomPolygon* splitAlongMax(float approxRatio, bool entranceBetween, int preDeterminedNum = -1) {
-		SplitStruct p = getSplitProposal(false, approxRatio, preDeterminedNum);
-		if (p.p1.X == 0.0f) {
+		SplitStruct p = to2D().getSplitProposal(false, approxRatio, preDeterminedNum);
+		// a failed proposal doesn't point at any sides
+		if (p.min == p.max) {
 			return nullptr;
 		}
 		return splitAlongSplitStruct(p, entranceBetween);
@@ -1286,6 +1608,12 @@ struct FHousePolygon : public FMetaPolygon {
 	UPROPERTY(EditAnywhere, BlueprintReadWrite)
 		TSet<int32> windows;
 
+	// the house position moves with the house
+	void offset(FVector offset) {
+		FPolygon::offset(offset);
+		housePosition += offset;
+	}
+
 	void removePoint(int place) {
 		if (points.Num() <= place) {
 			return;
@@ -1313,6 +1641,7 @@ struct FHousePolygon : public FMetaPolygon {
 			entrances.Add(i - 1 <= 0 ? i - 1 + points.Num() : i - 1);
 		}
 		points.RemoveAt(place);
+		invalidateBounds();
 	}
 	void addPoint(int place, FVector point) {
 		std::vector<int> toRemove;
@@ -1336,12 +1665,14 @@ struct FHousePolygon : public FMetaPolygon {
 			entrances.Add(i + 1);
 		}
 		points.EmplaceAt(place, point);
+		invalidateBounds();
 	}
 
 	FHousePolygon splitAlongMax(float spaceBetween) {
 
-		SplitStruct p = getSplitProposal(true, 0.5);
-		if (p.p1.X == 0.0f) {
+		SplitStruct p = to2D().getSplitProposal(true, 0.5);
+		// a failed proposal doesn't point at any sides
+		if (p.min == p.max) {
 			return FHousePolygon();
 		}
 
@@ -1411,6 +1742,7 @@ struct FHousePolygon : public FMetaPolygon {
 		points.RemoveAt(p.min, p.max - p.min);
 		points.EmplaceAt(p.min, p.p1);
 		points.EmplaceAt(p.min + 1, p.p2);
+		invalidateBounds();
 
 		//newP.checkOrientation();
 		return newP;
@@ -1502,18 +1834,77 @@ struct FRoadSegment : public FLine
 
 
 
+// proposed road during road generation, these live in a pool for the duration of one generation and refer to each other by index
 struct logicRoadSegment {
 	float time;
-	logicRoadSegment* previous;
-	FRoadSegment* segment;
+	// index in the pool of the road this one was grown from, INDEX_NONE for roads that start a network
+	int32 previous = INDEX_NONE;
+	FRoadSegment segment;
 	FRotator rotation;
 	int roadLength;
 };
 
+// what the road queue orders by, kept small so the heap never has to look into the pool
+struct roadQueueEntry {
+	float time;
+	int32 index;
+};
+
 struct roadComparator {
-	bool operator() (logicRoadSegment* arg1, logicRoadSegment* arg2) {
-		return arg1->time > arg2->time;
+	bool operator() (const roadQueueEntry &arg1, const roadQueueEntry &arg2) const {
+		return arg1.time > arg2.time;
+	}
+};
+
+struct roadQueue : public std::priority_queue<roadQueueEntry, std::vector<roadQueueEntry>, roadComparator> {
+	// the queued entries in heap order, the ones at the start will be popped soon
+	const std::vector<roadQueueEntry>& entries() const {
+		return c;
+	}
+};
+
+// packs two cell coordinates into a single map key, every pair of 32 bit coordinates gets its own key
+FORCEINLINE uint64 packCellKey(int32 x, int32 y) {
+	return (uint64(uint32(x)) << 32) | uint64(uint32(y));
+}
+
+// uniform grid of road segments, used to only look at the roads close to a new one instead of all of them.
+// every cell is a linked list running through the flat id/next arrays, so no arrays are allocated per cell
+struct RoadSegmentGrid {
+	RoadSegmentGrid(float cellSize = 5000.0f) : cellSize(cellSize) {}
+
+	// adds the id to every cell touched by the bounding box of the line, grown by margin
+	void add(int32 id, FVector p1, FVector p2, float margin = 0.0f);
+	// fills out with the ids in the cells touched by the bounding box of the line grown by margin, sorted and without duplicates
+	void query(FVector p1, FVector p2, float margin, TArray<int32> &out) const;
+	void reset(float newCellSize);
+	float getCellSize() const {
+		return cellSize;
 	}
+
+private:
+	float cellSize;
+	TMap<uint64, int32> heads;
+	TArray<int32> ids;
+	TArray<int32> next;
+};
+
+// coarse grid holding the penalty main roads give to new main roads close to them. every added point spreads its penalty
+// onto the grid nodes within range once, so finding the total penalty at a point only has to blend the four nodes around it
+struct RepulsionField {
+	RepulsionField(float range = 1000000.0f, float impact = 0.01f) { reset(range, impact); }
+
+	void add(FVector point);
+	float sample(FVector point) const;
+	void reset(float newRange, float newImpact);
+
+private:
+	// number of grid nodes along the range of a single point, higher is closer to the exact penalty but makes adding slower
+	static const int32 nodesPerRange = 16;
+	float range;
+	float impact;
+	float spacing;
+	TMap<uint64, float> nodes;
 };
 
 struct roomComparator {
@@ -1541,6 +1932,13 @@ struct FPlotInfo {
 		TArray<FHousePolygon> houses;
 	UPROPERTY(EditAnywhere, BlueprintReadWrite)
 		TArray<FSimplePlot> leftovers;
+
+	void offset(FVector offset) {
+		for (FHousePolygon &house : houses)
+			house.offset(offset);
+		for (FSimplePlot &fs : leftovers)
+			fs.offset(offset);
+	}
 };
 
 USTRUCT(BlueprintType)
@@ -1568,6 +1966,11 @@ public:
 	BaseLibrary();
 	~BaseLibrary();
 	static bool overrideSides;
+	// plots and houses are generated around an origin close to them instead of the world origin, so the float precision they get
+	// doesn't depend on how far out in the city they are. the results are only moved into place when the meshes are made
+	static bool localCoordinates;
+	// origin to generate a polygon around, the middle of its bounds rounded to whole meters
+	static FVector getLocalOrigin(const FPolygon &p);
 	UFUNCTION(BlueprintCallable, Category = conversion)
 		static TArray<FMaterialPolygon> getSimplePlotPolygons(TArray<FSimplePlot> plots);
 	static TArray<FMetaPolygon> getSurroundingPolygons(TArray<FRoadSegment> &segments, TArray<FRoadSegment> &blocking, float stdWidth, float extraLen, float extraRoadLen, float width, float middleOffset);
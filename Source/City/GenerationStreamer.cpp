@@ -0,0 +1,292 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "City.h"
+#include "GenerationStreamer.h"
+#include "CityCharacter.h"
+#include "Kismet/GameplayStatics.h"
+
+
+// Sets default values
+AGenerationStreamer::AGenerationStreamer()
+{
+ 	// Set this actor to call Tick() every frame.  You can turn this off to improve performance if you don't need it.
+	PrimaryActorTick.bCanEverTick = true;
+
+}
+
+// Called when the game starts or when spawned
+void AGenerationStreamer::BeginPlay()
+{
+	Super::BeginPlay();
+
+}
+
+void AGenerationStreamer::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	for (auto &pair : chunks)
+		evictChunk(pair.Value);
+	chunks.Empty();
+	pending.Empty();
+	queued.Empty();
+	Super::EndPlay(EndPlayReason);
+}
+
+static FBox2D getChunkBox(ASpawner *spawner, FIntPoint chunk) {
+	FVector origin = spawner->getChunkOrigin(chunk);
+	return FBox2D(FVector2D(origin), FVector2D(origin) + FVector2D(spawner->getChunkSize(), spawner->getChunkSize()));
+}
+
+void AGenerationStreamer::updateView() {
+	APawn *pawn = Cast<ACityCharacter>(UGameplayStatics::GetPlayerCharacter(GetWorld(), 0));
+	if (!pawn)
+		pawn = UGameplayStatics::GetPlayerPawn(GetWorld(), 0);
+	if (!pawn)
+		return;
+	viewLocation = pawn->GetActorLocation();
+	viewDirection = pawn->GetControlRotation().Vector();
+	viewDirection.Z = 0;
+	viewDirection.Normalize();
+}
+
+float AGenerationStreamer::getPriority(FVector position) {
+	// lower is sooner, things in front of the player count as closer than things behind
+	FVector toPosition = position - viewLocation;
+	toPosition.Z = 0;
+	float dist = toPosition.Size();
+	if (dist < 1.0f)
+		return 0;
+	return dist * (1 - viewDirectionWeight * FVector::DotProduct(toPosition / dist, viewDirection));
+}
+
+void AGenerationStreamer::queueWork(StreamWork type, FIntPoint chunk, int32 index, FVector position) {
+	StreamWorkItem item;
+	item.type = type;
+	item.chunk = chunk;
+	item.index = index;
+	item.position = position;
+	queued.Add(item);
+}
+
+void AGenerationStreamer::loadChunks() {
+	FIntPoint center = spawner->getChunkAt(viewLocation);
+	int32 range = FMath::CeilToInt(loadRadius / spawner->getChunkSize());
+	for (int32 x = center.X - range; x <= center.X + range; x++) {
+		for (int32 y = center.Y - range; y <= center.Y + range; y++) {
+			FIntPoint chunk(x, y);
+			if (chunks.Contains(chunk))
+				continue;
+			FBox2D box = getChunkBox(spawner, chunk);
+			if (box.ComputeSquaredDistanceToPoint(FVector2D(viewLocation)) > loadRadius * loadRadius)
+				continue;
+			chunks.Add(chunk, StreamedChunk());
+			FVector2D closest = box.GetClosestPointTo(FVector2D(viewLocation));
+			queueWork(StreamWork::roads, chunk, INDEX_NONE, FVector(closest.X, closest.Y, 0));
+		}
+	}
+}
+
+void AGenerationStreamer::evictChunk(StreamedChunk &chunk) {
+	// destroying the actors takes their meshes and instances with them
+	for (TWeakObjectPtr<AHouseBuilder> &house : chunk.houses) {
+		if (house.IsValid())
+			house->Destroy();
+	}
+	if (chunk.roadMesh.IsValid())
+		chunk.roadMesh->Destroy();
+	if (chunk.groundMesh.IsValid())
+		chunk.groundMesh->Destroy();
+	if (chunk.plotBuilder.IsValid())
+		chunk.plotBuilder->Destroy();
+}
+
+void AGenerationStreamer::evictChunks() {
+	TArray<FIntPoint> toEvict;
+	for (auto &pair : chunks) {
+		if (getChunkBox(spawner, pair.Key).ComputeSquaredDistanceToPoint(FVector2D(viewLocation)) > evictRadius * evictRadius)
+			toEvict.Add(pair.Key);
+	}
+	if (toEvict.Num() == 0)
+		return;
+
+	for (FIntPoint chunk : toEvict) {
+		evictChunk(chunks[chunk]);
+		chunks.Remove(chunk);
+		UE_LOG(LogTemp, Warning, TEXT("evicted chunk %i, %i"), chunk.X, chunk.Y);
+	}
+	// work not yet started for the removed chunks is cancelled
+	auto removed = [this](const StreamWorkItem &item) {
+		return !chunks.Contains(item.chunk);
+	};
+	pending.RemoveAll(removed);
+	queued.RemoveAll(removed);
+}
+
+void AGenerationStreamer::clampEvictRadius() {
+	float minEvictRadius = loadRadius + spawner->getChunkSize();
+	if (evictRadius < minEvictRadius) {
+		UE_LOG(LogTemp, Warning, TEXT("evictRadius %f is too close to loadRadius %f, using %f"), evictRadius, loadRadius, minEvictRadius);
+		evictRadius = minEvictRadius;
+	}
+}
+
+bool AGenerationStreamer::isStale(const StreamWorkItem &item) {
+	// a shell destroyed from outside the streamer never gets its interior, the chunk has to be loaded again for that
+	if (item.type == StreamWork::interior)
+		return chunks[item.chunk].houses[item.index].IsStale();
+	return false;
+}
+
+bool AGenerationStreamer::canDo(const StreamWorkItem &item) {
+	float dist = FVector::Dist2D(item.position, viewLocation);
+	// out of range work stays queued in case the player comes back, it's dropped with the chunk if not
+	if (dist > loadRadius)
+		return false;
+	if (item.type == StreamWork::interior) {
+		if (dist > interiorRadius)
+			return false;
+		// the shell has to be finished before the full house can replace it
+		const TWeakObjectPtr<AHouseBuilder> &house = chunks[item.chunk].houses[item.index];
+		return house.IsValid() && !house->workerWorking;
+	}
+	return true;
+}
+
+void AGenerationStreamer::doWork(const StreamWorkItem &item) {
+	StreamedChunk &chunk = chunks[item.chunk];
+	switch (item.type) {
+	case StreamWork::roads: buildRoads(item.chunk, chunk); break;
+	case StreamWork::blocks: buildBlocks(item.chunk, chunk); break;
+	case StreamWork::plot: buildPlot(item.chunk, chunk, item.index); break;
+	case StreamWork::shell: buildShell(chunk, item.index); break;
+	case StreamWork::interior: chunk.houses[item.index]->buildHouse(false); break;
+	}
+}
+
+void AGenerationStreamer::buildRoads(FIntPoint chunkPos, StreamedChunk &chunk) {
+	chunk.roads = spawner->determineChunkRoadSegments(chunkPos);
+
+	TArray<FMaterialPolygon> pols = spawner->roadPolygonsToMaterialPolygons(spawner->roadsToPolygons(chunk.roads));
+	pols.Append(spawner->getRoadLines(chunk.roads));
+	chunk.roadMesh = GetWorld()->SpawnActor<AProcMeshActor>(procMeshActorClass, FActorSpawnParameters());
+	chunk.roadMesh->init(generationMode);
+	chunk.roadMesh->buildMaterialPolygons(pols, FVector(0, 0, 0));
+
+	FVector2D closest = getChunkBox(spawner, chunkPos).GetClosestPointTo(FVector2D(viewLocation));
+	queueWork(StreamWork::blocks, chunkPos, INDEX_NONE, FVector(closest.X, closest.Y, 0));
+	UE_LOG(LogTemp, Warning, TEXT("streamed in chunk %i, %i"), chunkPos.X, chunkPos.Y);
+}
+
+void AGenerationStreamer::buildBlocks(FIntPoint chunkPos, StreamedChunk &chunk) {
+	chunk.blocks = APlotBuilder::sanityCheck(spawner->getChunkSurroundingPolygons(chunkPos, chunk.roads), TArray<FPolygon>());
+	// every chunk gets its own plot builder so its decorations can be removed with it
+	chunk.plotBuilder = GetWorld()->SpawnActor<APlotBuilder>(plotBuilderClass, FActorSpawnParameters());
+	chunk.plotBuilder->setNoiseContext(spawner->getNoiseContext());
+	chunk.plotsLeft = chunk.blocks.Num();
+	for (int32 i = 0; i < chunk.blocks.Num(); i++) {
+		queueWork(StreamWork::plot, chunkPos, i, chunk.blocks[i].getCenter());
+	}
+}
+
+void AGenerationStreamer::buildPlot(FIntPoint chunkPos, StreamedChunk &chunk, int32 index) {
+	// removed from outside the streamer, the rest of the chunk can't be built without it
+	if (!chunk.plotBuilder.IsValid())
+		return;
+	FPlotPolygon plot = classifyPlot(chunk.blocks[index]);
+	FPlotInfo info = chunk.plotBuilder->generateHousePolygons(plot, minFloors, maxFloors);
+
+	chunk.ground.Append(chunk.plotBuilder->getSideWalkPolygons(plot, sidewalkWidth));
+	chunk.ground.Append(BaseLibrary::getSimplePlotPolygons(info.leftovers));
+	for (FSimplePlot &fs : info.leftovers) {
+		for (FMeshInfo &mesh : fs.meshes) {
+			UHierarchicalInstancedStaticMeshComponent **component = chunk.plotBuilder->instancedMap.Find(mesh.description);
+			if (component)
+				(*component)->AddInstance(mesh.transform);
+		}
+	}
+
+	for (FHousePolygon &house : info.houses) {
+		int32 houseIndex = chunk.housePols.Add(house);
+		chunk.houses.Add(nullptr);
+		queueWork(StreamWork::shell, chunkPos, houseIndex, house.housePosition);
+		queueWork(StreamWork::interior, chunkPos, houseIndex, house.housePosition);
+	}
+
+	chunk.plotsLeft--;
+	if (chunk.plotsLeft == 0) {
+		chunk.groundMesh = GetWorld()->SpawnActor<AProcMeshActor>(procMeshActorClass, FActorSpawnParameters());
+		chunk.groundMesh->init(generationMode);
+		chunk.groundMesh->buildMaterialPolygons(chunk.ground, FVector(0, 0, 0));
+		chunk.ground.Empty();
+	}
+}
+
+void AGenerationStreamer::buildShell(StreamedChunk &chunk, int32 index) {
+	AHouseBuilder *house = GetWorld()->SpawnActor<AHouseBuilder>(houseBuilderClass, FActorSpawnParameters());
+	house->init(chunk.housePols[index], floorHeight, makeInterestingAttempts, generateRoofs, generationMode);
+	house->buildHouse(true);
+	chunk.houses[index] = house;
+}
+
+FPlotPolygon AGenerationStreamer::classifyPlot_Implementation(FMetaPolygon block) {
+	FPlotPolygon plot;
+	plot.points = block.points;
+	plot.open = block.open;
+	plot.isClockwise = block.isClockwise;
+	FVector center = block.getCenter();
+	FRandomStream stream(center.X * 1000 + center.Y);
+	plot.population = spawner->getNoiseContext().noise(center.X, center.Y);
+	plot.type = plot.population > 0.6 ? RoomType::office : RoomType::apartment;
+	plot.simplePlotType = stream.FRand() < 0.5 ? SimplePlotType::green : SimplePlotType::asphalt;
+	return plot;
+}
+
+int32 AGenerationStreamer::getPendingWork() {
+	return pending.Num() + queued.Num();
+}
+
+int32 AGenerationStreamer::getLoadedChunks() {
+	return chunks.Num();
+}
+
+// Called every frame
+void AGenerationStreamer::Tick(float DeltaTime)
+{
+	Super::Tick(DeltaTime);
+	if (!spawner)
+		return;
+
+	updateView();
+	clampEvictRadius();
+	evictChunks();
+	loadChunks();
+	pending.Append(queued);
+	queued.Empty();
+
+	pending.RemoveAll([this](const StreamWorkItem &item) {
+		return isStale(item);
+	});
+	for (StreamWorkItem &item : pending)
+		item.priority = getPriority(item.position);
+	auto sooner = [](const StreamWorkItem &a, const StreamWorkItem &b) {
+		return a.priority < b.priority;
+	};
+	pending.Heapify(sooner);
+
+	double begin = FPlatformTime::Seconds();
+	TArray<StreamWorkItem> deferred;
+	int32 done = 0;
+	while (pending.Num() > 0 && done < workPerTick && FPlatformTime::Seconds() - begin < tickTimeBudget) {
+		StreamWorkItem item;
+		pending.HeapPop(item, sooner, false);
+		if (!canDo(item)) {
+			deferred.Add(item);
+			continue;
+		}
+		doWork(item);
+		done++;
+	}
+	pending.Append(deferred);
+	// new work from this tick gets its priority next tick
+	pending.Append(queued);
+	queued.Empty();
+}
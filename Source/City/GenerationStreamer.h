@@ -0,0 +1,144 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "GameFramework/Actor.h"
+#include "Spawner.h"
+#include "PlotBuilder.h"
+#include "GenerationStreamer.generated.h"
+
+// the stages a chunk goes through, each one depends on the one before it
+enum class StreamWork : uint8 {
+	roads,
+	blocks,
+	plot,
+	shell,
+	interior
+};
+
+struct StreamWorkItem {
+	StreamWork type;
+	FIntPoint chunk;
+	// plot or house in the chunk, depending on type
+	int32 index = INDEX_NONE;
+	FVector position;
+	float priority = 0;
+};
+
+struct StreamedChunk {
+	TArray<FRoadSegment> roads;
+	TArray<FMetaPolygon> blocks;
+	TArray<FHousePolygon> housePols;
+	// the actors are weak since the chunks aren't seen by the garbage collector and they can be destroyed without the streamer knowing
+	TArray<TWeakObjectPtr<AHouseBuilder>> houses;
+	// ground polygons are collected from all plots and built together once the last plot is done
+	TArray<FMaterialPolygon> ground;
+	int32 plotsLeft = 0;
+	TWeakObjectPtr<AProcMeshActor> roadMesh;
+	TWeakObjectPtr<AProcMeshActor> groundMesh;
+	TWeakObjectPtr<APlotBuilder> plotBuilder;
+};
+
+// builds the city around the player chunk by chunk, nearest and most visible work first, and removes everything that gets too far away
+UCLASS()
+class CITY_API AGenerationStreamer : public AActor
+{
+	GENERATED_BODY()
+
+	// spawner providing the roads and blocks of every chunk
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = streaming, meta = (AllowPrivateAccess = "true"))
+		ASpawner *spawner;
+
+	// chunks closer than this to the player are generated
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = streaming, meta = (AllowPrivateAccess = "true"))
+		float loadRadius = 600000;
+	// chunks further away than this are removed, raised to at least a chunk more than loadRadius so chunks on the border aren't rebuilt over and over
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = streaming, meta = (AllowPrivateAccess = "true"))
+		float evictRadius = 900000;
+	// houses closer than this get their interiors
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = streaming, meta = (AllowPrivateAccess = "true"))
+		float interiorRadius = 20000;
+	// how much looking towards something makes it come earlier, 0 means only distance matters
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = streaming, meta = (AllowPrivateAccess = "true"))
+		float viewDirectionWeight = 0.5;
+	// most work items started in a single tick
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = performance, meta = (AllowPrivateAccess = "true"))
+		int32 workPerTick = 4;
+	// no new work is started in a tick after this many seconds have been spent
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = performance, meta = (AllowPrivateAccess = "true"))
+		float tickTimeBudget = 0.005;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = performance, meta = (AllowPrivateAccess = "true"))
+		GenerationMode generationMode;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = house, meta = (AllowPrivateAccess = "true"))
+		int32	minFloors = 3;
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = house, meta = (AllowPrivateAccess = "true"))
+		int32	maxFloors = 60;
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = house, meta = (AllowPrivateAccess = "true"))
+		float floorHeight = 400.0f;
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = house, meta = (AllowPrivateAccess = "true"))
+		int makeInterestingAttempts = 4;
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = house, meta = (AllowPrivateAccess = "true"))
+		bool generateRoofs = true;
+
+	// width of the sidewalk around every plot
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = sidewalk, meta = (AllowPrivateAccess = "true"))
+		float sidewalkWidth = 300;
+
+	TMap<FIntPoint, StreamedChunk> chunks;
+	TArray<StreamWorkItem> pending;
+	// added since the last tick, kept apart so the pending heap stays intact while working through it
+	TArray<StreamWorkItem> queued;
+
+	FVector viewLocation;
+	FVector viewDirection;
+
+	void updateView();
+	float getPriority(FVector position);
+	void queueWork(StreamWork type, FIntPoint chunk, int32 index, FVector position);
+	void loadChunks();
+	void evictChunks();
+	void evictChunk(StreamedChunk &chunk);
+	void clampEvictRadius();
+	// returns true if the item can never be done anymore and should be dropped
+	bool isStale(const StreamWorkItem &item);
+	// returns false if the item can't be done yet and should stay in the queue
+	bool canDo(const StreamWorkItem &item);
+	void doWork(const StreamWorkItem &item);
+
+	void buildRoads(FIntPoint chunkPos, StreamedChunk &chunk);
+	void buildBlocks(FIntPoint chunkPos, StreamedChunk &chunk);
+	void buildPlot(FIntPoint chunkPos, StreamedChunk &chunk, int32 index);
+	void buildShell(StreamedChunk &chunk, int32 index);
+
+public:
+	// Sets default values for this actor's properties
+	AGenerationStreamer();
+
+	UPROPERTY(EditDefaultsOnly, BlueprintReadOnly, Category = classes)
+		TSubclassOf<class AHouseBuilder> houseBuilderClass;
+	UPROPERTY(EditDefaultsOnly, BlueprintReadOnly, Category = classes)
+		TSubclassOf<class APlotBuilder> plotBuilderClass;
+	UPROPERTY(EditDefaultsOnly, BlueprintReadOnly, Category = classes)
+		TSubclassOf<class AProcMeshActor> procMeshActorClass;
+
+	// decides what a block is used for, the default uses the noise at its center
+	UFUNCTION(BlueprintNativeEvent, Category = "Generation")
+		FPlotPolygon classifyPlot(FMetaPolygon block);
+
+	UFUNCTION(BlueprintCallable, Category = "Streaming")
+		int32 getPendingWork();
+	UFUNCTION(BlueprintCallable, Category = "Streaming")
+		int32 getLoadedChunks();
+
+protected:
+	// Called when the game starts or when spawned
+	virtual void BeginPlay() override;
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+
+public:
+	// Called every frame
+	virtual void Tick(float DeltaTime) override;
+
+};
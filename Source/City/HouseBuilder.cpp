@@ -1,11 +1,11 @@
 
 #include "City.h"
 #include "HouseBuilder.h"
+#include "Async/ParallelFor.h"
+#include "Kismet/GameplayStatics.h"
 struct FPolygon;
 
 
-std::atomic<unsigned int> AHouseBuilder::workersWorking{ 0 };
-std::atomic<unsigned int> AHouseBuilder::housesWorking{ 0 };
 
 AHouseBuilder::AHouseBuilder()
 {
@@ -25,6 +25,44 @@ struct twoInt {
 	int32 b;
 };
 
+bool AHouseBuilder::reuseFloorTemplates = true;
+
+// what a floor above the ground floor is generated from. these are decided for all floors in order first, then the floors are generated at once
+struct FloorJob {
+	FHousePolygon footprint;
+	WindowType windowType;
+	// the house stream as it was at the floor
+	FRandomStream stream;
+	int floor;
+	FRoomInfo result;
+};
+
+// the floors above the ground floor only depend on the footprint, the window type and the specification, one is built for every
+// combination in a house. its polygons become a floor chunk shown at every floor using it, its meshes are copied to them
+struct FloorTemplate {
+	uint32 hash;
+	TArray<FVector> points;
+	TSet<int32> windows;
+	WindowType windowType;
+	ApartmentSpecification *spec;
+	// the job building it, and the chunk in the floors of the house info with the same index
+	int32 job;
+
+	bool matches(uint32 hash_in, const FHousePolygon &f, WindowType windowType_in, ApartmentSpecification *spec_in) const {
+		return hash == hash_in && windowType == windowType_in && spec == spec_in && points == f.points
+			&& windows.Num() == f.windows.Num() && windows.Includes(f.windows);
+	}
+};
+
+static uint32 getFootprintHash(const FHousePolygon &f) {
+	uint32 hash = 0;
+	for (const FVector &point : f.points)
+		hash = HashCombine(hash, GetTypeHash(point));
+	for (int32 window : f.windows)
+		hash = HashCombine(hash, GetTypeHash(window));
+	return hash;
+}
+
 TArray<FMaterialPolygon> getEntrancePolygons(FVector begin, FVector end, float height, float thickness) {
 	FMaterialPolygon polygon;
 
@@ -94,18 +132,16 @@ TArray<FRoomPolygon> getInteriorPlanAndPlaceEntrancePolygons(FHousePolygon &f, F
 		FVector altTangent = FRotator(0, 270, 0).RotateVector(tangent);
 		FVector firstAttach = hole.points[i- 1] + (midPos - corrWidth * 0.5) * tangent;
 		FVector sndAttach = FVector(0.0f, 0.0f, 0.0f);
+		bool attached = false;
 		int conn = 0;
-		for (int j = 1; j < f.points.Num()+1; j++) {
-			FVector res = intersection(firstAttach, firstAttach + altTangent * 100000, f.points[j - 1], f.points[j%f.points.Num()]);
-			if (res.X != 0.0f) {
-				sndAttach = res;
-				conn = j;
-				break;
-			}
-
+		SegmentHit res = intersection(firstAttach, firstAttach + altTangent * 100000, f.points.GetData(), f.points.Num(), true);
+		if (res.hit) {
+			sndAttach = res.point;
+			attached = true;
+			conn = res.index;
 		}
 		FVector prevAttach;
-		if (sndAttach.X == 0.0f)
+		if (!attached)
 			return TArray<FRoomPolygon>();
 		if (!ground || !f.entrances.Contains(conn)) {
 			corners.points.Add(sndAttach);
@@ -121,13 +157,12 @@ TArray<FRoomPolygon> getInteriorPlanAndPlaceEntrancePolygons(FHousePolygon &f, F
 
 		firstAttach = hole.points[i-1] + (midPos + corrWidth * 0.5) * tangent;
 		sndAttach = FVector(0.0f, 0.0f, 0.0f);
-		for (int j = 1; j < f.points.Num()+1; j++) {
-			FVector res = intersection(firstAttach, firstAttach + altTangent * 100000, f.points[j - 1], f.points[j%f.points.Num()]);
-			if (res.X != 0.0f) {
-				sndAttach = res;
-				conn = j;
-				break;
-			}
+		attached = false;
+		res = intersection(firstAttach, firstAttach + altTangent * 100000, f.points.GetData(), f.points.Num(), true);
+		if (res.hit) {
+			sndAttach = res.point;
+			attached = true;
+			conn = res.index;
 		}
 
 		if (!ground || !f.entrances.Contains(conn)) {
@@ -136,7 +171,7 @@ TArray<FRoomPolygon> getInteriorPlanAndPlaceEntrancePolygons(FHousePolygon &f, F
 			corners.points.Add(sndAttach);
 		}
 		else {
-			if (sndAttach.X != 0.0f && FVector::Dist(prevAttach, sndAttach) < 1000.0f)
+			if (attached && FVector::Dist(prevAttach, sndAttach) < 1000.0f)
 				pols.Append(getEntrancePolygons(prevAttach, sndAttach, 390, 50));
 		}
 
@@ -293,9 +328,10 @@ FSimplePlot attemptMoveSideInwards(FHousePolygon &f, int place, FPolygon &center
 	FVector toChange2To = f.points[place%f.points.Num()] + dir2 * len;
 	line.points.Add(toChange1To);
 	line.points.Add(toChange2To);
-	if (intersection(line, centerHole).X == 0.0f && intersection(line, f).X == 0.0f) {
+	if (!intersection(line, centerHole).hit && !intersection(line, f).hit) {
 		f.points[place - 1] = toChange1To;
 		f.points[place%f.points.Num()] = toChange2To;
+		f.invalidateBounds();
 		pol.points.Add(toChange1To);
 		pol.points.Add(toChange2To);
 		pol.offset(offset);
@@ -315,7 +351,7 @@ FSimplePlot attemptRemoveCorner(FHousePolygon &f, int place, FPolygon &centerHol
 	simplePlot.pol.points.Add(p1);
 	simplePlot.pol.points.Add(p2);
 	simplePlot.pol.points.Add(f.points[place%f.points.Num()]);
-	if (intersection(simplePlot.pol, centerHole).X == 0.0f) {
+	if (!intersection(simplePlot.pol, centerHole).hit) {
 		bool hadW = f.windows.Contains(place);
 		bool hadE = f.entrances.Contains(place);
 
@@ -361,7 +397,7 @@ FSimplePlot attemptTurnSideIntoU(FHousePolygon &f, int place, FPolygon &centerHo
 	//simplePlot.pol.reverse();
 		
 	FHousePolygon cp = f;
-	if (intersection(simplePlot.pol, centerHole).X == 0.0f && !selfIntersection(simplePlot.pol)) {
+	if (!intersection(simplePlot.pol, centerHole).hit && !selfIntersection(simplePlot.pol)) {
 		simplePlot.type = f.simplePlotType;
 
 
@@ -408,8 +444,10 @@ void AHouseBuilder::makeInteresting(FHousePolygon &f, TArray<FSimplePlot> &toRet
 	else if (stream.FRand() < 0.05f) {
 		float shrinkLen = stream.FRandRange(150, 1500);
 		FHousePolygon cp = FHousePolygon(f);
-		cp.symmetricShrink(shrinkLen, false);
-		if (intersection(cp, centerHole).X == 0.0f && !selfIntersection(cp)) {
+		FPolygon2D shrunk = cp.to2D();
+		shrunk.symmetricShrink(shrinkLen, false);
+		cp.set2D(shrunk);
+		if (!intersection(cp, centerHole).hit && !selfIntersection(cp)) {
 			TArray<FPolygon> holes;
 			holes.Add(cp);
 			TArray<FMaterialPolygon> res = ARoomBuilder::getSideWithHoles(f, holes, PolygonType::roof);
@@ -554,7 +592,7 @@ void addDetailOnPolygon(int depth, int maxDepth, int maxBoxes, FMaterialPolygon
 		FMaterialPolygon shape = pol;
 		shape.offset(FVector(0, 0, offset));
 		FVector center = shape.getCenter();
-		SplitStruct res = pol.getSplitProposal(false, 0.5);
+		SplitStruct res = pol.to2D().getSplitProposal(false, 0.5);
 		float maxDist = FVector::Dist(res.p1, res.p2)/2;
 		if (maxDist > 150 && res.min != -1) {
 			float dist = stream.FRandRange(150.0f, maxDist);
@@ -645,8 +683,10 @@ TArray<FMaterialPolygon> potentiallyShrink(FHousePolygon &f, FPolygon &centerHol
 	else if (stream.FRand() < 0.2) {
 		float shrinkLen = stream.FRandRange(150, 1500);
 		FHousePolygon cp = FHousePolygon(f);
-		cp.symmetricShrink(shrinkLen, false);
-		if (intersection(cp, centerHole).X == 0.0f && !selfIntersection(cp)) {
+		FPolygon2D shrunk = cp.to2D();
+		shrunk.symmetricShrink(shrinkLen, false);
+		cp.set2D(shrunk);
+		if (!intersection(cp, centerHole).hit && !selfIntersection(cp)) {
 			TArray<FPolygon> holes;
 			holes.Add(cp);
 			TArray<FMaterialPolygon> res = ARoomBuilder::getSideWithHoles(f, holes, PolygonType::roof);
@@ -690,17 +730,56 @@ TArray<FMaterialPolygon> potentiallyShrink(FHousePolygon &f, FPolygon &centerHol
 	return toReturn;
 }
 
+void AHouseBuilder::benchmarkFloorTemplates(int32 runs) {
+	const bool previous = reuseFloorTemplates;
+	for (int32 pass = 0; pass < 2; pass++) {
+		reuseFloorTemplates = pass == 1;
+		double begin = FPlatformTime::Seconds();
+		// polygons that have to be triangulated, a floor chunk only once however many floors it is shown at
+		int32 pols = 0;
+		for (int32 i = 0; i < runs; i++) {
+			FHouseInfo info = getHouseInfo();
+			pols += info.roomInfo.pols.Num();
+			for (FFloorChunk &chunk : info.floors)
+				pols += chunk.pols.Num();
+		}
+		UE_LOG(LogTemp, Warning, TEXT("time to generate %i houses %s floor templates: %f, %i polygons"), runs, pass == 1 ? TEXT("with") : TEXT("without"), FPlatformTime::Seconds() - begin, pols);
+	}
+	reuseFloorTemplates = previous;
+}
+
+void AHouseBuilder::benchmarkHouseGeneration(int32 runs) {
+	const bool previous = FPolygon::useBoundsEarlyOut;
+	for (int32 pass = 0; pass < 2; pass++) {
+		FPolygon::useBoundsEarlyOut = pass == 1;
+		double begin = FPlatformTime::Seconds();
+		for (int32 i = 0; i < runs; i++) {
+			getHouseInfo();
+		}
+		UE_LOG(LogTemp, Warning, TEXT("time to generate %i houses %s bounding box early outs: %f"), runs, pass == 1 ? TEXT("with") : TEXT("without"), FPlatformTime::Seconds() - begin);
+	}
+	FPolygon::useBoundsEarlyOut = previous;
+}
+
 void AHouseBuilder::buildHouse(bool shellOnly_in) {
 
+	// a newer request replaces one that isn't done yet
+	if (workerWorking)
+		HouseTaskPool::get().cancel(taskId);
 	shellOnly = shellOnly_in;
-	if (workerWantsToWork) {
-		workerWantsToWork = false;
-		if (!isWorking)
-			SetActorTickEnabled(false);
-		return;
-	}
-	SetActorTickEnabled(true);
-	workerWantsToWork = true;
+	// houses closer to the player are generated first
+	float priority = 0;
+	APawn *pawn = UGameplayStatics::GetPlayerPawn(GetWorld(), 0);
+	if (pawn)
+		priority = FVector::Dist2D(f.getCenter(), pawn->GetActorLocation());
+	taskId = HouseTaskPool::get().submit(this, priority, maxThreads);
+	workerWorking = true;
+}
+
+void AHouseBuilder::receiveHouseInfo(FHouseInfo &&res) {
+	taskId = 0;
+	workerWorking = false;
+	buildHouseFromInfo(MoveTemp(res));
 }
 
 void AHouseBuilder::buildHouseFromInfo(FHouseInfo res) {
@@ -714,37 +793,63 @@ void AHouseBuilder::buildHouseFromInfo(FHouseInfo res) {
 		procMeshActor = GetWorld()->SpawnActor<AProcMeshActor>(procMeshActorClass, FActorSpawnParameters());
 		procMeshActor->init(generationMode);
 	}
+	// the polygons stay relative to the origin of the info and the mesh actor is moved there instead, instances are placed in the world
+	procMeshActor->SetActorLocation(res.origin);
 	for (FSimplePlot &fs : res.remainingPlots) {
 		fs.decorate(map);
 		//res.roomInfo.meshes.Append(fs.meshes);
 		for (FMeshInfo mesh : fs.meshes) {
+					mesh.transform.AddToTranslation(res.origin);
 					map[mesh.description]->AddInstance(mesh.transform);
 			}
 	}
+	for (FMeshInfo &mesh : res.roomInfo.meshes)
+		mesh.transform.AddToTranslation(res.origin);
 	res.roomInfo.pols.Append(BaseLibrary::getSimplePlotPolygons(res.remainingPlots));
 
 	currentIndex = 0;
-	procMeshActor->buildMaterialPolygons(res.roomInfo.pols, FVector(0, 0, 0));
-	meshesToPlace = res.roomInfo.meshes;
+	procMeshActor->buildHouseMeshes(res.roomInfo.pols, res.floors);
+	meshesToPlace = MoveTemp(res.roomInfo.meshes);
 	isWorking = true;
+	// the house only ticks while it has meshes left to place
+	SetActorTickEnabled(true);
 
 }
 
 
+HouseTaskInput AHouseBuilder::getTaskInput() const {
+	return HouseTaskInput{ f, floorHeight, makeInterestingAttempts, maxChangeIntensity, generateRoofs, shellOnly, map };
+}
+
 FHouseInfo AHouseBuilder::getHouseInfo()
 {
-	float dist = FVector::Dist(f[0], f[f.points.Num() - 1]);
+	return generateHouseInfo(getTaskInput());
+}
+
+FHouseInfo AHouseBuilder::generateHouseInfo(const HouseTaskInput &input)
+{
+	// a copy of its own, the footprint is changed along the way
+	FHousePolygon f = input.f;
+	const float floorHeight = input.floorHeight;
+	const int makeInterestingAttempts = input.makeInterestingAttempts;
+	const float maxChangeIntensity = input.maxChangeIntensity;
+	const bool generateRoofs = input.generateRoofs;
+	const bool shellOnly = input.shellOnly;
+	TMap<FString, UHierarchicalInstancedStaticMeshComponent*> map = input.map;
+	float dist = FVector::Dist(f.points[0], f.points[f.points.Num() - 1]);
 	UE_LOG(LogTemp, Warning, TEXT("dist between start and end: %f"), dist);
 	FRandomStream stream;
 	float corrWidth = 300;
-	FHousePolygon pre = f;
 	FVector center = f.getCenter();
 	stream.Initialize(center.X + center.Y);
+	// the house is built around its own origin and only moved into place when its meshes are made, the seed above still comes from the world position
+	FVector origin = BaseLibrary::localCoordinates ? BaseLibrary::getLocalOrigin(f) : FVector(0, 0, 0);
+	f.offset(-origin);
 	f.checkOrientation();
 	FPolygon hole = getShaftHolePolygon(f, stream);
-	if (intersection(hole, f).X != 0.0f) {
+	if (intersection(hole, f).hit) {
 		hole = getShaftHolePolygon(f, stream, true);
-		if (intersection(hole, f).X != 0.0f) {
+		if (intersection(hole, f).hit) {
 			// the house is too small for the shaft to fit, don't build the house, just turn the area into a simpleplot
 			FHouseInfo emptyH;
 			FSimplePlot whole;
@@ -752,6 +857,7 @@ FHouseInfo AHouseBuilder::getHouseInfo()
 			whole.pol.offset(FVector(0, 0, simplePlotGroundOffset));
 			whole.type = f.simplePlotType;
 			emptyH.remainingPlots.Add(whole);
+			emptyH.origin = origin;
 			return emptyH;
 		}
 
@@ -836,6 +942,15 @@ FHouseInfo AHouseBuilder::getHouseInfo()
 	bool horizontalFacade = stream.FRand() < 0.15;
 	// we want to send the same stream to apartment generation so that it generates the same windows for each floor
 	auto unchangingCP = stream;
+	TArray<FloorJob> jobs;
+	// job for every floor from 1, the same job for floors sharing a template
+	TArray<int32> floorJobs;
+	TArray<FloorTemplate> templates;
+	// the template the last floor came from, only looked up again when the footprint or window type has changed
+	int32 currentTemplate = INDEX_NONE;
+	bool footprintChanged = true;
+	WindowType templateWindowType = currentWindowType;
+	// everything that draws from the stream or changes the footprint happens here in order, the floors themselves are generated after
 	for (int i = 1; i < floors; i++) {
 		if (i == windowChangeCutoff)
 			currentWindowType = WindowType(stream.RandRange(0,3));
@@ -843,6 +958,7 @@ FHouseInfo AHouseBuilder::getHouseInfo()
 		if (stream.FRand() < myChangeIntensity && f.canBeModified) {
 			TArray<FMaterialPolygon> shrinkRes = potentiallyShrink(f, hole, stream, FVector(0, 0, floorHeight*i + 1));
 			toReturn.roomInfo.pols.Append(shrinkRes);
+			footprintChanged = true;
 		}
 
 		if (!shellOnly) {
@@ -852,14 +968,56 @@ FHouseInfo AHouseBuilder::getHouseInfo()
 		if (horizontalFacade)
 			addFacade(f, toReturn.roomInfo, floorHeight*i - 50, 70, 20);
 
-		roomPols = getInteriorPlanAndPlaceEntrancePolygons(f, hole, false, corrWidth, stream, toReturn.roomInfo.pols, spec->getMaxApartmentSize());
-		for (FRoomPolygon &p : roomPols) {
-			p.windowType = currentWindowType;
-			FRoomInfo newR = spec->buildApartment(&p, i, floorHeight, map, potentialBalcony, shellOnly, unchangingCP);
-			newR.offset(FVector(0, 0, floorHeight*i));
-			toReturn.roomInfo.pols.Append(newR.pols);
-			toReturn.roomInfo.meshes.Append(newR.meshes);
+		if (!reuseFloorTemplates) {
+			floorJobs.Add(jobs.Add(FloorJob{ f, currentWindowType, stream, i }));
+			continue;
+		}
+		if (footprintChanged || templateWindowType != currentWindowType) {
+			uint32 hash = getFootprintHash(f);
+			currentTemplate = templates.IndexOfByPredicate([&](const FloorTemplate &t) { return t.matches(hash, f, currentWindowType, spec); });
+			if (currentTemplate == INDEX_NONE)
+				currentTemplate = templates.Add(FloorTemplate{ hash, f.points, f.windows, currentWindowType, spec, jobs.Add(FloorJob{ f, currentWindowType, stream, i }) });
+			footprintChanged = false;
+			templateWindowType = currentWindowType;
+		}
+		floorJobs.Add(templates[currentTemplate].job);
+	}
+
+	// a floor only reads its own job, so they can all be generated at the same time. only done while the house pool has idle workers, otherwise
+	// every core is already busy generating a house and the floors are generated one after the other on this thread
+	ParallelFor(jobs.Num(), [&](int32 j) {
+		FloorJob &job = jobs[j];
+		// nothing is added here for floors above the ground floor, it's only there for the signature
+		TArray<FMaterialPolygon> entrancePols;
+		TArray<FRoomPolygon> floorRooms = getInteriorPlanAndPlaceEntrancePolygons(job.footprint, hole, false, corrWidth, job.stream, entrancePols, spec->getMaxApartmentSize());
+		for (FRoomPolygon &p : floorRooms) {
+			p.windowType = job.windowType;
+			FRoomInfo newR = spec->buildApartment(&p, job.floor, floorHeight, map, potentialBalcony, shellOnly, unchangingCP);
+			job.result.pols.Append(newR.pols);
+			job.result.meshes.Append(newR.meshes);
+		}
+	}, !HouseTaskPool::hasIdleWorkers());
+
+	if (reuseFloorTemplates) {
+		for (FloorJob &job : jobs) {
+			FFloorChunk chunk;
+			chunk.pols = MoveTemp(job.result.pols);
+			toReturn.floors.Add(MoveTemp(chunk));
+		}
+	}
+	for (int i = 1; i < floors; i++) {
+		int32 j = floorJobs[i - 1];
+		FRoomInfo floorInfo;
+		if (reuseFloorTemplates) {
+			toReturn.floors[j].offsets.Add(floorHeight*i);
+			floorInfo.meshes = jobs[j].result.meshes;
 		}
+		else {
+			floorInfo = MoveTemp(jobs[j].result);
+		}
+		floorInfo.offset(FVector(0, 0, floorHeight*i));
+		toReturn.roomInfo.pols.Append(floorInfo.pols);
+		toReturn.roomInfo.meshes.Append(floorInfo.meshes);
 	}
 	if (!shellOnly) {
 		for (int i = 1; i <= floors; i++) {
@@ -909,8 +1067,8 @@ FHouseInfo AHouseBuilder::getHouseInfo()
 			boxRoof.reverse();
 			TArray<FMaterialPolygon> sides = getSidesOfPolygon(boxRoof, PolygonType::exterior, floorHeight);
 			FMaterialPolygon &exitSide = sides[0];
-			FVector middleP = middle(exitSide[2], exitSide[1]);
-			FPolygon entH = getEntranceHole(exitSide[2], exitSide[1], floorHeight, 297, 137, middleP);
+			FVector middleP = middle(exitSide.points[2], exitSide.points[1]);
+			const FPolygon entH = getEntranceHole(exitSide.points[2], exitSide.points[1], floorHeight, 297, 137, middleP);
 			exitSide.points.EmplaceAt(2, entH[2]);
 			exitSide.points.EmplaceAt(3, entH[3]);
 			exitSide.points.EmplaceAt(4, entH[0]);
@@ -918,7 +1076,7 @@ FHouseInfo AHouseBuilder::getHouseInfo()
 
 			sides.Add(boxRoof);
 			placed.Add(boxRoof);
-			toReturn.roomInfo.meshes.Add(getEntranceMesh(exitSide[2], exitSide[1], middleP));
+			toReturn.roomInfo.meshes.Add(getEntranceMesh(exitSide.points[2], exitSide.points[1], middleP));
 			toReturn.roomInfo.pols.Append(sides);
 		}
 		else {
@@ -933,7 +1091,7 @@ FHouseInfo AHouseBuilder::getHouseInfo()
 	if (generateRoofs) {
 		addRoofDetail(roof, toReturn.roomInfo, stream, map, placed, !roofAccess);
 	}
-	f = pre;
+	toReturn.origin = origin;
 	return toReturn;
 }
 
@@ -944,28 +1102,23 @@ void AHouseBuilder::BeginPlay()
 	
 }
 
-// Called every frame
-void AHouseBuilder::Tick(float DeltaTime)
+void AHouseBuilder::EndPlay(const EEndPlayReason::Type EndPlayReason)
 {
-	Super::Tick(DeltaTime);
-	if (workerWantsToWork && workersWorking.load(std::memory_order_relaxed) < maxThreads) {
-		workerWantsToWork = false;
-		workersWorking++;
-		worker = new ThreadedWorker(this);
-		workerWorking = true;
-	}
-
-	if (workerWorking && worker->IsFinished()) {
-		buildHouseFromInfo(worker->resultingInfo);
-		delete worker;
-		worker = nullptr;
+	if (workerWorking) {
+		HouseTaskPool::get().cancel(taskId);
+		taskId = 0;
 		workerWorking = false;
-		workersWorking--;
-		//if (!isWorking)
-			//SetActorTickEnabled(false);
-
 	}
+	if (procMeshActor && !procMeshActor->IsPendingKill())
+		procMeshActor->Destroy();
+	procMeshActor = nullptr;
+	Super::EndPlay(EndPlayReason);
+}
 
+// Called every frame
+void AHouseBuilder::Tick(float DeltaTime)
+{
+	Super::Tick(DeltaTime);
 	if (isWorking) {
 		int nextStop = std::min(currentIndex + meshesPerTick, meshesToPlace.Num());
 		for (;currentIndex < nextStop; currentIndex++) {
@@ -974,8 +1127,7 @@ void AHouseBuilder::Tick(float DeltaTime)
 		}
 		if (nextStop == meshesToPlace.Num()) {
 			isWorking = false;
-			//if (!workerWorking)
-			//	SetActorTickEnabled(false);
+			SetActorTickEnabled(false);
 
 		}
 	}
@@ -10,7 +10,8 @@
 #include "atomic"
 #include "HouseBuilder.generated.h"
 
-class ThreadedWorker;
+class HouseTaskPool;
+struct HouseTaskInput;
 
 UCLASS()
 class CITY_API AHouseBuilder : public AActor
@@ -30,6 +31,7 @@ class CITY_API AHouseBuilder : public AActor
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = performance, meta = (AllowPrivateAccess = "true"))
 	GenerationMode generationMode;
 
+	// most houses being generated by the task pool at once, the pool holds back the rest until earlier ones are done
 	unsigned int maxThreads = 1;
 
 	bool shellOnly = false;
@@ -42,10 +44,6 @@ class CITY_API AHouseBuilder : public AActor
 	TArray<UTextRenderComponent*> texts;
 
 public:
-	static std::atomic<unsigned int> housesWorking;
-
-	static std::atomic<unsigned int> workersWorking;
-
 	// Sets default values for this actor's properties
 	AHouseBuilder();
 	~AHouseBuilder();
@@ -94,24 +92,46 @@ public:
 	UFUNCTION(BlueprintCallable, Category = "Generation")
 	FHouseInfo getHouseInfo();
 
+	// copy of everything generating the house reads
+	HouseTaskInput getTaskInput() const;
+
+	// generates the house from a copy of its inputs, doesn't touch the house so it can run on any thread
+	static FHouseInfo generateHouseInfo(const HouseTaskInput &input);
+
+	// generates the house given to init a number of times without and with the bounding box early outs in the polygon tests, logs the time for both
+	UFUNCTION(BlueprintCallable, Category = "Test")
+	void benchmarkHouseGeneration(int32 runs = 20);
+
+	// builds every floor with the same footprint and window type once and returns it as a floor chunk, off builds every floor by itself
+	static bool reuseFloorTemplates;
+
+	// generates the house given to init a number of times without and with floor templates, logs the time and polygon count for both
+	UFUNCTION(BlueprintCallable, Category = "Test")
+	void benchmarkFloorTemplates(int32 runs = 20);
+
 	UFUNCTION(BlueprintCallable, Category = "Generation")
 	void buildHouse(bool shellOnly);
 
 	UFUNCTION(BlueprintCallable, Category = "Generation")
 	void buildHouseFromInfo(FHouseInfo res);
 
+	// called on the game thread by the task pool when the house data is done, the house takes over the info
+	void receiveHouseInfo(FHouseInfo &&res);
+
 	static void makeInteresting(FHousePolygon &f, TArray<FSimplePlot> &toReturn, FPolygon &centerHole, FRandomStream stream);
 
 	static FPolygon getShaftHolePolygon(FHousePolygon f, FRandomStream stream, bool useCenter = false);
 
-	ThreadedWorker *worker;
+	// task in the house task pool while workerWorking is set
+	uint32 taskId = 0;
 
 	bool workerWorking = false;
-	bool workerWantsToWork = false;
 
 protected:
 	// Called when the game starts or when spawned
 	virtual void BeginPlay() override;
+	// cancels the task so the house can be removed while it's being generated
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
 	
 
 public:	
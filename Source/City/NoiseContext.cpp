@@ -0,0 +1,348 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "City.h"
+#include "NoiseContext.h"
+#include "simplexnoise.h"
+#include <algorithm>
+
+
+TSharedPtr<const FNoiseHeatmap, ESPMode::ThreadSafe> FNoiseHeatmap::decode(UTexture2D* image) {
+	TSharedPtr<FNoiseHeatmap, ESPMode::ThreadSafe> heatmap = MakeShareable(new FNoiseHeatmap());
+
+	FTexture2DMipMap* MyMipMap = &image->PlatformData->Mips[0];
+	FByteBulkData* RawImageData = &MyMipMap->BulkData;
+	const FColor* FormatedImageData = static_cast<const FColor*>(RawImageData->Lock(LOCK_READ_ONLY));
+	int32 width = MyMipMap->SizeX;
+	int32 height = MyMipMap->SizeY;
+	TArray<uint8> &base = heatmap->levels[heatmap->levels.AddDefaulted()];
+	base.SetNumUninitialized(width * height);
+	for (int32 i = 0; i < width * height; i++) {
+		base[i] = FormatedImageData[i].R;
+	}
+	RawImageData->Unlock();
+	heatmap->sizes.Add(FIntPoint(width, height));
+
+	// every level averages 2x2 pixels of the one before, edge pixels are repeated for odd sizes
+	while (width > 1 || height > 1) {
+		int32 newWidth = std::max(width / 2, 1);
+		int32 newHeight = std::max(height / 2, 1);
+		const TArray<uint8> &prev = heatmap->levels.Last();
+		TArray<uint8> next;
+		next.SetNumUninitialized(newWidth * newHeight);
+		for (int32 j = 0; j < newHeight; j++) {
+			int32 y0 = std::min(j * 2, height - 1);
+			int32 y1 = std::min(j * 2 + 1, height - 1);
+			for (int32 i = 0; i < newWidth; i++) {
+				int32 x0 = std::min(i * 2, width - 1);
+				int32 x1 = std::min(i * 2 + 1, width - 1);
+				int32 sum = prev[y0 * width + x0] + prev[y0 * width + x1] + prev[y1 * width + x0] + prev[y1 * width + x1];
+				next[j * newWidth + i] = (sum + 2) / 4;
+			}
+		}
+		heatmap->levels.Add(MoveTemp(next));
+		width = newWidth;
+		height = newHeight;
+		heatmap->sizes.Add(FIntPoint(width, height));
+	}
+	UE_LOG(LogTemp, Warning, TEXT("decoded heat map: %i x %i, %i levels"), heatmap->sizes[0].X, heatmap->sizes[0].Y, heatmap->levels.Num());
+	return heatmap;
+}
+
+float FNoiseHeatmap::texel(int32 level, int32 x, int32 y) const {
+	const FIntPoint &size = sizes[level];
+	// outside of the map counts as empty
+	if (x < 0 || y < 0 || x >= size.X || y >= size.Y)
+		return 0.0f;
+	return levels[level][y * size.X + x] / 255.0f;
+}
+
+float FNoiseHeatmap::sample(float u, float v, int32 level, bool bilinear) const {
+	if (levels.Num() == 0)
+		return 0.0f;
+	level = FMath::Clamp(level, 0, levels.Num() - 1);
+	if (level > 0) {
+		float levelScale = 1.0f / (1 << level);
+		u *= levelScale;
+		v *= levelScale;
+	}
+	if (!bilinear) {
+		return texel(level, FMath::FloorToInt(u), FMath::FloorToInt(v));
+	}
+	// pixel values are at pixel centers
+	u -= 0.5f;
+	v -= 0.5f;
+	int32 x = FMath::FloorToInt(u);
+	int32 y = FMath::FloorToInt(v);
+	float fx = u - x;
+	float fy = v - y;
+	float top = FMath::Lerp(texel(level, x, y), texel(level, x + 1, y), fx);
+	float bottom = FMath::Lerp(texel(level, x, y + 1), texel(level, x + 1, y + 1), fx);
+	return FMath::Lerp(top, bottom, fy);
+}
+
+FNoiseContext FNoiseContext::makePerlin(float scale, float xOffset, float yOffset) {
+	FNoiseContext context;
+	context.noiseScale = scale;
+	context.xOffset = xOffset;
+	context.yOffset = yOffset;
+	context.useTexture = false;
+	return context;
+}
+
+FNoiseContext FNoiseContext::makeImage(float scale, UTexture2D* image, float textureScale, bool bilinear, TSharedPtr<const FNoiseHeatmap, ESPMode::ThreadSafe> decoded) {
+	FNoiseContext context;
+	context.noiseScale = scale;
+	context.noiseTextureScale = textureScale;
+	context.useTexture = true;
+	context.bilinear = bilinear;
+	context.heatmap = decoded.IsValid() ? decoded : FNoiseHeatmap::decode(image);
+
+	uint32 TextureWidth = context.heatmap->sizes[0].X, TextureHeight = context.heatmap->sizes[0].Y;
+	UE_LOG(LogTemp, Warning, TEXT("start x,y: %f, %f"), (TextureWidth / (textureScale * scale)), (TextureHeight / (textureScale * scale)));
+	context.xOffset = (TextureWidth / (textureScale * scale)) / 2;
+	context.yOffset = (TextureHeight / (textureScale * scale)) / 2;
+	return context;
+}
+
+FNoiseTileCache::FNoiseTileCache(int32 maxTiles, float tileSize, int32 resolution, int32 octaves, float lacunarity, float persistence)
+	: maxTiles(std::max(maxTiles, 1)), tileSize(tileSize), resolution(std::max(resolution, 1)), octaves(std::max(octaves, 1)), lacunarity(lacunarity), persistence(persistence) {
+	// the tiles are split evenly, at least one each
+	for (int32 i = 0; i < shardCount; i++)
+		shards[i].maxTiles = std::max((this->maxTiles + shardCount - 1 - i) / shardCount, 1);
+}
+
+bool FNoiseTileCache::hasSettings(int32 maxTiles_in, float tileSize_in, int32 resolution_in, int32 octaves_in, float lacunarity_in, float persistence_in) const {
+	return maxTiles == std::max(maxTiles_in, 1) && tileSize == tileSize_in && resolution == std::max(resolution_in, 1)
+		&& octaves == std::max(octaves_in, 1) && lacunarity == lacunarity_in && persistence == persistence_in;
+}
+
+int32 FNoiseTileCache::getTileCount() {
+	int32 count = 0;
+	for (Shard &shard : shards) {
+		FScopeLock scopeLock(&shard.lock);
+		count += shard.tiles.Num();
+	}
+	return count;
+}
+
+int64 FNoiseTileCache::getHits() {
+	int64 count = 0;
+	for (Shard &shard : shards) {
+		FScopeLock scopeLock(&shard.lock);
+		count += shard.hits;
+	}
+	return count;
+}
+
+int64 FNoiseTileCache::getMisses() {
+	int64 count = 0;
+	for (Shard &shard : shards) {
+		FScopeLock scopeLock(&shard.lock);
+		count += shard.misses;
+	}
+	return count;
+}
+
+int64 FNoiseTileCache::getEvictions() {
+	int64 count = 0;
+	for (Shard &shard : shards) {
+		FScopeLock scopeLock(&shard.lock);
+		count += shard.evictions;
+	}
+	return count;
+}
+
+void FNoiseTileCache::resetCounters() {
+	for (Shard &shard : shards) {
+		FScopeLock scopeLock(&shard.lock);
+		shard.hits = 0;
+		shard.misses = 0;
+		shard.evictions = 0;
+	}
+}
+
+void FNoiseTileCache::fill(const FNoiseContext &context, int32 tileX, int32 tileY, TArray<float> &values) const {
+	int32 side = resolution + 1;
+	int32 count = side * side;
+	float step = tileSize / resolution;
+	TArray<float> xs;
+	TArray<float> ys;
+	TArray<float> octave;
+	xs.SetNumUninitialized(count);
+	ys.SetNumUninitialized(count);
+	octave.SetNumUninitialized(count);
+	values.SetNumZeroed(count);
+
+	// fBm, the same sum as SimplexNoise::fractal but over the context noise so heat maps work as well
+	float frequency = 1.0f;
+	float amplitude = 1.0f;
+	float denom = 0.0f;
+	for (int32 o = 0; o < octaves; o++) {
+		for (int32 j = 0; j < side; j++) {
+			for (int32 i = 0; i < side; i++) {
+				xs[j * side + i] = (tileX * tileSize + i * step) * frequency;
+				ys[j * side + i] = (tileY * tileSize + j * step) * frequency;
+			}
+		}
+		context.directNoise(xs.GetData(), ys.GetData(), octave.GetData(), count);
+		for (int32 i = 0; i < count; i++)
+			values[i] += amplitude * octave[i];
+		denom += amplitude;
+		frequency *= lacunarity;
+		amplitude *= persistence;
+	}
+	for (int32 i = 0; i < count; i++)
+		values[i] /= denom;
+}
+
+void FNoiseTileCache::Shard::unlink(int32 index) {
+	Tile &tile = tiles[index];
+	if (tile.prev != INDEX_NONE)
+		tiles[tile.prev].next = tile.next;
+	else
+		head = tile.next;
+	if (tile.next != INDEX_NONE)
+		tiles[tile.next].prev = tile.prev;
+	else
+		tail = tile.prev;
+	tile.prev = INDEX_NONE;
+	tile.next = INDEX_NONE;
+}
+
+void FNoiseTileCache::Shard::pushFront(int32 index) {
+	Tile &tile = tiles[index];
+	tile.prev = INDEX_NONE;
+	tile.next = head;
+	if (head != INDEX_NONE)
+		tiles[head].prev = index;
+	head = index;
+	if (tail == INDEX_NONE)
+		tail = index;
+}
+
+float FNoiseTileCache::sample(const FNoiseContext &context, float x, float y) {
+	float u = x / tileSize;
+	float v = y / tileSize;
+	int32 tileX = FMath::FloorToInt(u);
+	int32 tileY = FMath::FloorToInt(v);
+	uint64 key = (uint64(uint32(tileX)) << 32) | uint32(tileY);
+	// position inside the tile in cells
+	float cellX = (u - tileX) * resolution;
+	float cellY = (v - tileY) * resolution;
+	int32 i = FMath::Clamp(FMath::FloorToInt(cellX), 0, resolution - 1);
+	int32 j = FMath::Clamp(FMath::FloorToInt(cellY), 0, resolution - 1);
+	float fx = cellX - i;
+	float fy = cellY - j;
+	int32 side = resolution + 1;
+
+	// neighbouring tiles land in different shards
+	Shard &shard = shards[(uint32(tileX) * 7 + uint32(tileY)) % shardCount];
+	FScopeLock scopeLock(&shard.lock);
+	int32 *found = shard.lookup.Find(key);
+	int32 index;
+	if (found) {
+		shard.hits++;
+		index = *found;
+		if (index != shard.head) {
+			shard.unlink(index);
+			shard.pushFront(index);
+		}
+	}
+	else {
+		shard.misses++;
+		if (shard.tiles.Num() < shard.maxTiles) {
+			index = shard.tiles.AddDefaulted();
+		}
+		else {
+			// reuse the least recently used tile
+			index = shard.tail;
+			shard.unlink(index);
+			shard.lookup.Remove(shard.tiles[index].key);
+			shard.evictions++;
+		}
+		shard.tiles[index].key = key;
+		fill(context, tileX, tileY, shard.tiles[index].values);
+		shard.lookup.Add(key, index);
+		shard.pushFront(index);
+	}
+
+	const TArray<float> &values = shard.tiles[index].values;
+	float top = FMath::Lerp(values[j * side + i], values[j * side + i + 1], fx);
+	float bottom = FMath::Lerp(values[(j + 1) * side + i], values[(j + 1) * side + i + 1], fx);
+	return FMath::Lerp(top, bottom, fy);
+}
+
+FNoiseContext FNoiseContext::withCache(int32 maxTiles, float tileSize, int32 resolution, int32 octaves, float lacunarity, float persistence, const FNoiseContext *previous) const {
+	FNoiseContext context = *this;
+	if (previous && previous->cache.IsValid() && sameNoise(*previous) && previous->cache->hasSettings(maxTiles, tileSize, resolution, octaves, lacunarity, persistence))
+		context.cache = previous->cache;
+	else
+		context.cache = MakeShareable(new FNoiseTileCache(maxTiles, tileSize, resolution, octaves, lacunarity, persistence));
+	return context;
+}
+
+bool FNoiseContext::sameNoise(const FNoiseContext &other) const {
+	if (useTexture != other.useTexture || noiseScale != other.noiseScale || xOffset != other.xOffset || yOffset != other.yOffset)
+		return false;
+	return !useTexture || (noiseTextureScale == other.noiseTextureScale && bilinear == other.bilinear && heatmap == other.heatmap);
+}
+
+float FNoiseContext::noise(float x, float y) const {
+	if (cache.IsValid())
+		return cache->sample(*this, x, y);
+	return directNoise(x, y);
+}
+
+float FNoiseContext::directNoise(float x, float y) const {
+	if (!useTexture) {
+		float val = SimplexNoise::simplexnoise(noiseScale * x + xOffset, noiseScale*y + yOffset);
+		return val * 0.5 + 0.5;
+	}
+	if (!heatmap.IsValid())
+		return 0.0f;
+	return heatmap->sample((x + xOffset) * noiseScale * noiseTextureScale, (y + yOffset) * noiseScale * noiseTextureScale, 0, bilinear);
+}
+
+float FNoiseContext::noise(float x, float y, int32 level) const {
+	if (!useTexture)
+		return directNoise(x, y);
+	if (!heatmap.IsValid())
+		return 0.0f;
+	return heatmap->sample((x + xOffset) * noiseScale * noiseTextureScale, (y + yOffset) * noiseScale * noiseTextureScale, level, bilinear);
+}
+
+void FNoiseContext::noise(const float *x, const float *y, float *out, int32 count, bool vectorized) const {
+	if (cache.IsValid()) {
+		for (int32 i = 0; i < count; i++)
+			out[i] = cache->sample(*this, x[i], y[i]);
+		return;
+	}
+	directNoise(x, y, out, count, vectorized);
+}
+
+void FNoiseContext::directNoise(const float *x, const float *y, float *out, int32 count, bool vectorized) const {
+	if (count <= 0)
+		return;
+	if (!useTexture) {
+		TArray<float> scaledX;
+		TArray<float> scaledY;
+		scaledX.SetNumUninitialized(count);
+		scaledY.SetNumUninitialized(count);
+		for (int32 i = 0; i < count; i++) {
+			scaledX[i] = noiseScale * x[i] + xOffset;
+			scaledY[i] = noiseScale * y[i] + yOffset;
+		}
+		if (vectorized)
+			SimplexNoise::simplexnoise(scaledX.GetData(), scaledY.GetData(), out, count);
+		else
+			SimplexNoise::simplexnoiseScalar(scaledX.GetData(), scaledY.GetData(), out, count);
+		for (int32 i = 0; i < count; i++) {
+			out[i] = out[i] * 0.5 + 0.5;
+		}
+	}
+	else {
+		for (int32 i = 0; i < count; i++) {
+			out[i] = heatmap.IsValid() ? heatmap->sample((x[i] + xOffset) * noiseScale * noiseTextureScale, (y[i] + yOffset) * noiseScale * noiseTextureScale, 0, bilinear) : 0.0f;
+		}
+	}
+}
@@ -0,0 +1,127 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Engine/Texture2D.h"
+#include "Misc/ScopeLock.h"
+#include "NoiseContext.generated.h"
+
+// red channel of a heat map texture, decoded once so sampling doesn't need to lock the texture. level 0 is the full texture, every level after is half the size of the one before
+struct FNoiseHeatmap {
+	TArray<TArray<uint8>> levels;
+	TArray<FIntPoint> sizes;
+
+	static TSharedPtr<const FNoiseHeatmap, ESPMode::ThreadSafe> decode(UTexture2D* image);
+
+	float texel(int32 level, int32 x, int32 y) const;
+	// value at u, v in pixels of the full texture, read from the given level
+	float sample(float u, float v, int32 level, bool bilinear) const;
+};
+
+struct FNoiseContext;
+
+// noise kept in square tiles of resolution x resolution cells, filled in the first time something in them is read. only the maxTiles last used tiles are kept.
+// values in between the samples are interpolated, so several octaves of fBm cost no more to read than one. safe to use from several threads, the tiles are
+// spread over shards with a lock each so threads reading different tiles rarely wait for each other
+class CITY_API FNoiseTileCache {
+public:
+	FNoiseTileCache(int32 maxTiles, float tileSize, int32 resolution, int32 octaves, float lacunarity, float persistence);
+
+	float sample(const FNoiseContext &context, float x, float y);
+
+	// whether the cache was made with these settings, so it can be kept for a new context reading the same noise
+	bool hasSettings(int32 maxTiles, float tileSize, int32 resolution, int32 octaves, float lacunarity, float persistence) const;
+
+	int64 getHits();
+	int64 getMisses();
+	int64 getEvictions();
+	int32 getTileCount();
+	void resetCounters();
+
+private:
+	struct Tile {
+		uint64 key;
+		// (resolution + 1)^2 samples, the last row and column are the first of the next tiles so lookups never need a neighbour
+		TArray<float> values;
+		int32 prev = INDEX_NONE;
+		int32 next = INDEX_NONE;
+	};
+
+	// a least recently used list of its own, the tiles of a key always end up in the same shard
+	struct Shard {
+		FCriticalSection lock;
+		int32 maxTiles = 1;
+		TMap<uint64, int32> lookup;
+		TArray<Tile> tiles;
+		// most recently used first
+		int32 head = INDEX_NONE;
+		int32 tail = INDEX_NONE;
+		// counted under the lock, so sampling doesn't touch anything shared with the other shards
+		int64 hits = 0;
+		int64 misses = 0;
+		int64 evictions = 0;
+
+		void unlink(int32 index);
+		void pushFront(int32 index);
+	};
+
+	static const int32 shardCount = 16;
+
+	void fill(const FNoiseContext &context, int32 tileX, int32 tileY, TArray<float> &values) const;
+
+	int32 maxTiles;
+	float tileSize;
+	int32 resolution;
+	int32 octaves;
+	float lacunarity;
+	float persistence;
+
+	Shard shards[shardCount];
+};
+
+// everything needed to read the noise, never changes after being made so it can be copied around and read from any thread
+USTRUCT(BlueprintType)
+struct FNoiseContext {
+	GENERATED_USTRUCT_BODY();
+
+	UPROPERTY(BlueprintReadOnly)
+		float noiseScale = 0.0;
+	UPROPERTY(BlueprintReadOnly)
+		float noiseTextureScale = 0.0;
+	UPROPERTY(BlueprintReadOnly)
+		float xOffset = 0;
+	UPROPERTY(BlueprintReadOnly)
+		float yOffset = 0;
+	UPROPERTY(BlueprintReadOnly)
+		bool useTexture = false;
+	// smooth out the heat map between pixels instead of using the nearest one
+	UPROPERTY(BlueprintReadOnly)
+		bool bilinear = false;
+
+	// shared between all copies of the context
+	TSharedPtr<const FNoiseHeatmap, ESPMode::ThreadSafe> heatmap;
+	// when set, noise is read from cached tiles instead of being computed every time
+	TSharedPtr<FNoiseTileCache, ESPMode::ThreadSafe> cache;
+
+	// the offsets decide which part of the noise is read, pick them from a seeded stream to get a different city per seed
+	static FNoiseContext makePerlin(float scale, float xOffset, float yOffset);
+	// offsets put the middle of the texture at the origin. pass the heat map of an earlier context to skip decoding the same texture again
+	static FNoiseContext makeImage(float scale, UTexture2D* image, float textureScale, bool bilinear = false, TSharedPtr<const FNoiseHeatmap, ESPMode::ThreadSafe> decoded = nullptr);
+
+	// copy of this context reading through a new tile cache, octaves above 1 sum up fBm noise with the given lacunarity and persistence.
+	// the cache of previous is kept instead if it reads the same noise with the same settings
+	FNoiseContext withCache(int32 maxTiles, float tileSize = 20000, int32 resolution = 64, int32 octaves = 1, float lacunarity = 2.0f, float persistence = 0.5f, const FNoiseContext *previous = nullptr) const;
+	// whether both read the same values, not counting the cache
+	bool sameNoise(const FNoiseContext &other) const;
+
+	float noise(float x, float y) const;
+	// noise without going through the cache
+	float directNoise(float x, float y) const;
+	void directNoise(const float *x, const float *y, float *out, int32 count, bool vectorized = true) const;
+	// noise for count points at once, much faster than one at a time for the simplex noise
+	void noise(const float *x, const float *y, float *out, int32 count, bool vectorized = true) const;
+	// noise from a coarser level of the heat map, for queries covering large areas. the same as noise(x, y) for the simplex noise
+	float noise(float x, float y, int32 level) const;
+	int32 getHeatmapLevels() const { return heatmap.IsValid() ? heatmap->levels.Num() : 0; }
+};
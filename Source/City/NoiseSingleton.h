@@ -2,41 +2,38 @@
 
 #pragma once
 
+#include "NoiseContext.h"
+
 /**
- * 
+ * global noise kept for code that doesn't get a noise context passed to it, everything is forwarded to the current context
  */
 class CITY_API NoiseSingleton
 {
-	//static float noiseTextureScale;
-	//static float noiseScale;
 private:
 	NoiseSingleton();
-	static NoiseSingleton* instance;
-	UTexture2D* image;
+	FNoiseContext context;
+	UTexture2D* image = nullptr;
+	bool bilinear = false;
 
 public:
-	float noiseScale = 0.0;
-	float noiseTextureScale = 0.0;
-	float xOffset = 0;
-	float yOffset = 0;
-	void setNoiseScale(float inScale) { noiseScale = inScale; }
-
 	static NoiseSingleton* getInstance() {
-		if (instance == nullptr)
-			instance = new NoiseSingleton();
-		return instance;
+		// function statics are created exactly once even with several threads asking at the same time
+		static NoiseSingleton instance;
+		return &instance;
 	}
 
-	float noise(float x, float y);
+	const FNoiseContext& getContext() const { return context; }
+	void setContext(const FNoiseContext &inContext) { context = inContext; }
+
+	void setNoiseScale(float inScale) { context.noiseScale = inScale; }
+	float noise(float x, float y) { return context.noise(x, y); }
+	void noise(const float *x, const float *y, float *out, int32 count, bool vectorized = true) { context.noise(x, y, out, count, vectorized); }
+	float noise(float x, float y, int32 level) { return context.noise(x, y, level); }
 	void initForPerlin(float inX, float inY);
 	void initForImage();
-	bool useTexture = false;
 
-	void setUseTexture(UTexture2D* inImage, float scale) {
-		useTexture = true;
-		this->image = inImage;
-		this->noiseTextureScale = scale;
-	}
+	void setUseTexture(UTexture2D* inImage, float scale);
+	void setBilinear(bool inBilinear) { bilinear = inBilinear; context.bilinear = inBilinear; }
 	~NoiseSingleton();
 
 	
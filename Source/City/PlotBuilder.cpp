@@ -3,6 +3,7 @@
 #include "City.h"
 #include "NoiseSingleton.h"
 #include "PlotBuilder.h"
+#include "Async/ParallelFor.h"
 #include <random>
 #include <ctime>
 
@@ -23,18 +24,28 @@ void APlotBuilder::BeginPlay()
 
 TArray<FMetaPolygon> APlotBuilder::sanityCheck(TArray<FMetaPolygon> plots, TArray<FPolygon> others) {
 	TArray<FMetaPolygon> added;
-	for (FMetaPolygon p : plots) {
-		bool shouldAdd = !p.open;
-		if (shouldAdd) {
-			for (FMetaPolygon a : added) {
-				if (testCollision(p, a, 0)) {
-					shouldAdd = false;
-					break;
-				}
+	// plots are only tested against the added plots whose bounding boxes share a cell with theirs
+	RoadSegmentGrid grid(20000.0f);
+	TArray<int32> nearby;
+	for (FMetaPolygon &p : plots) {
+		if (p.open || p.points.Num() < 3)
+			continue;
+		FBox2D box(ForceInit);
+		for (const FVector &point : p.points)
+			box += FVector2D(point);
+		FVector min(box.Min, 0);
+		FVector max(box.Max, 0);
+		grid.query(min, max, 0, nearby);
+		bool shouldAdd = true;
+		for (int32 i : nearby) {
+			if (testCollision(p, added[i], 0)) {
+				shouldAdd = false;
+				break;
 			}
 		}
-		if (shouldAdd)
-			added.Add(p);
+		if (shouldAdd) {
+			grid.add(added.Add(MoveTemp(p)), min, max);
+		}
 	}
 	return added;
 }
@@ -92,7 +103,7 @@ FCityDecoration APlotBuilder::getCityDecoration(TArray<FMetaPolygon> plots, TArr
 		testLine.p1 = line.p1 - tan * 100;
 		testLine.p2 = line.p2 + tan * 100;
 		for (FMetaPolygon &plot : plots) {
-			if (intersection(testLine.p1, testLine.p2, plot).X != 0.0f) {
+			if (intersection(testLine.p1, testLine.p2, plot).hit) {
 				if (firstHit) {
 					sndHit = &plot;
 					// if these two plots werent previously connected, connections are added and crossing is placed, otherwise discard
@@ -134,8 +145,7 @@ FCityDecoration APlotBuilder::getCityDecoration(TArray<FMetaPolygon> plots, TArr
 	return dec;
 }
 
-float getHeight(FRandomStream &stream, int minFloors, int maxFloors, FVector position, float noiseHeightInfluence) {
-	float noise = NoiseSingleton::getInstance()->noise(position.X, position.Y);
+float getHeight(FRandomStream &stream, int minFloors, int maxFloors, float noise, float noiseHeightInfluence) {
 	float adjustedNoiseFactor = (1.0 - noiseHeightInfluence) + (noise*noiseHeightInfluence);
 	// value inbetween 0..1
 	float modifier = -std::log(stream.FRandRange(std::min(1.02 - adjustedNoiseFactor/* e^(-4) */, 1.0), 1.0)) / 4;
@@ -143,7 +153,7 @@ float getHeight(FRandomStream &stream, int minFloors, int maxFloors, FVector pos
 	return minFloors + (maxFloors - minFloors)*modifier*adjustedNoiseFactor;
 }
 
-FHousePolygon getRandomModel(float minSize, float maxSize, int minFloors, int maxFloors, RoomType type, FRandomStream stream, float noiseHeightInfluence) {
+FHousePolygon getRandomModel(float minSize, float maxSize, int minFloors, int maxFloors, RoomType type, FRandomStream stream, const FNoiseContext &noise, float noiseHeightInfluence) {
 	FHousePolygon pol;
 	float xLen = stream.FRandRange(minSize, maxSize);
 	float yLen = stream.FRandRange(minSize, maxSize);
@@ -161,18 +171,49 @@ FHousePolygon getRandomModel(float minSize, float maxSize, int minFloors, int ma
 		pol.open = false;
 	}
 	pol.housePosition = pol.getCenter();
-	pol.height = getHeight(stream, minFloors, maxFloors, pol.getCenter(), noiseHeightInfluence);
+	FVector center = pol.getCenter();
+	pol.height = getHeight(stream, minFloors, maxFloors, noise.noise(center.X, center.Y), noiseHeightInfluence);
 	pol.type = type;
 	pol.offset(-pol.getCenter());
 	return pol;
 }
 
 
+FNoiseContext APlotBuilder::getNoiseContext() {
+	return hasNoiseContext ? noiseContext : NoiseSingleton::getInstance()->getContext();
+}
+
 FPlotInfo APlotBuilder::generateHousePolygons(FPlotPolygon p, int minFloors, int maxFloors) {
+	return generatePlot(p, minFloors, maxFloors, getNoiseContext());
+}
+
+FPlotInfo APlotBuilder::generateAllHousePolygons(TArray<FPlotPolygon> plots, int minFloors, int maxFloors) {
+	double begin = FPlatformTime::Seconds();
+	FNoiseContext noise = getNoiseContext();
+	TArray<FPlotInfo> infos;
+	infos.SetNum(plots.Num());
+	// every plot seeds its own stream from its center, so the result doesn't depend on which thread gets which plot
+	ParallelFor(plots.Num(), [&](int32 i) {
+		infos[i] = generatePlot(plots[i], minFloors, maxFloors, noise);
+	});
+
+	FPlotInfo all;
+	for (FPlotInfo &info : infos) {
+		all.houses.Append(info.houses);
+		all.leftovers.Append(info.leftovers);
+	}
+	UE_LOG(LogTemp, Warning, TEXT("time to generate house polygons for %i plots: %f"), plots.Num(), FPlatformTime::Seconds() - begin);
+	return all;
+}
+
+FPlotInfo APlotBuilder::generatePlot(FPlotPolygon p, int minFloors, int maxFloors, const FNoiseContext &noise) const {
 	FPlotInfo info;
 	FVector cen = p.getCenter();
 	FRandomStream stream(cen.X * 1000 + cen.Y);
 	std::clock_t begin = clock();
+	// the plot is worked on around its own origin, the seed above still comes from where it is in the world
+	FVector origin = BaseLibrary::localCoordinates ? BaseLibrary::getLocalOrigin(p) : FVector(0, 0, 0);
+	p.offset(-origin);
 	p.checkOrientation();
 	float maxMaxArea = 6000.0f;
 	float minMaxArea = 3000;
@@ -198,7 +239,7 @@ FPlotInfo APlotBuilder::generateHousePolygons(FPlotPolygon p, int minFloors, int
 		bool normalPlacement = p.getArea() < 3000 || stream.FRand() < 0.85;
 		if (!normalPlacement) {
 			// create a special plot with several similar houses placed around an area, this happens in real cities sometimes
-			FHousePolygon model = getRandomModel(3500,6000, minFloors, maxFloors, p.type, stream, noiseHeightInfluence);
+			FHousePolygon model = getRandomModel(3500,6000, minFloors, maxFloors, p.type, stream, noise, noiseHeightInfluence);
 			model.checkOrientation();
 			model.canBeModified = false;
 			FPolygon shaft = AHouseBuilder::getShaftHolePolygon(model, stream);
@@ -211,7 +252,7 @@ FPlotInfo APlotBuilder::generateHousePolygons(FPlotPolygon p, int minFloors, int
 			for (int i = 0; i < 6; i++) {
 				FHousePolygon newH = model;
 				newH.rotate(FRotator(0, stream.FRandRange(0, 360), 0));
-				newH.offset(p.getRandomPoint(true, 2000));
+				newH.offset(p.getRandomPoint(true, 2000, stream));
 				newH.housePosition = newH.getCenter();
 				newH.type = p.type;
 				newH.simplePlotType = p.simplePlotType;
@@ -226,7 +267,7 @@ FPlotInfo APlotBuilder::generateHousePolygons(FPlotPolygon p, int minFloors, int
 			}
 			else {
 				FSimplePlot fs = FSimplePlot(p.simplePlotType, p, simplePlotGroundOffset);
-				fs.decorate(placed, instancedMap);
+				fs.decorate(placed, instancedMap, stream);
 				info.leftovers.Add(fs);
 
 			}
@@ -235,7 +276,7 @@ FPlotInfo APlotBuilder::generateHousePolygons(FPlotPolygon p, int minFloors, int
 			// have a chance of just making it empty
 			if (stream.FRand() < 0.05) {
 				FSimplePlot fs = FSimplePlot(p.simplePlotType, p, simplePlotGroundOffset);
-				fs.decorate(instancedMap);
+				fs.decorate(instancedMap, stream);
 				info.leftovers.Add(fs);
 			}
 			else {
@@ -243,7 +284,7 @@ FPlotInfo APlotBuilder::generateHousePolygons(FPlotPolygon p, int minFloors, int
 				if (p.getArea() > currMaxArea * 8) {
 					// area is too large for even the max number of buildings, just make it a green simple plot
 					FSimplePlot fs = FSimplePlot(SimplePlotType::green, p, simplePlotGroundOffset);
-					fs.decorate(instancedMap);
+					fs.decorate(instancedMap, stream);
 					info.leftovers.Add(fs);
 				}
 				// too big to even be reasonable to make a simple plot, ignore it
@@ -252,9 +293,21 @@ FPlotInfo APlotBuilder::generateHousePolygons(FPlotPolygon p, int minFloors, int
 				}
 				else {
 				TArray<FHousePolygon> refinedPolygons = original.refine(currMaxArea, 0, 0);
-				for (FHousePolygon r : refinedPolygons) {
+				// noise for all houses at once
+				TArray<float> xs;
+				TArray<float> ys;
+				TArray<float> noises;
+				for (FHousePolygon &r : refinedPolygons) {
+					FVector center = r.getCenter() + origin;
+					xs.Add(center.X);
+					ys.Add(center.Y);
+				}
+				noises.SetNumUninitialized(refinedPolygons.Num());
+				noise.noise(xs.GetData(), ys.GetData(), noises.GetData(), refinedPolygons.Num());
+				for (int32 i = 0; i < refinedPolygons.Num(); i++) {
+					FHousePolygon r = refinedPolygons[i];
 					r.housePosition = r.getCenter();
-					r.height = getHeight(stream, minFloors, maxFloors, r.getCenter(), noiseHeightInfluence);
+					r.height = getHeight(stream, minFloors, maxFloors, noises[i], noiseHeightInfluence);
 					r.type = p.type;
 					r.simplePlotType = p.simplePlotType;
 
@@ -264,7 +317,7 @@ FPlotInfo APlotBuilder::generateHousePolygons(FPlotPolygon p, int minFloors, int
 						// too small, turn into simple plot
 						FSimplePlot fs = FSimplePlot(p.simplePlotType, r, simplePlotGroundOffset);
 						fs.type = p.simplePlotType;
-						fs.decorate(instancedMap);
+						fs.decorate(instancedMap, stream);
 						info.leftovers.Add(fs);
 					}
 					else {
@@ -277,6 +330,7 @@ FPlotInfo APlotBuilder::generateHousePolygons(FPlotPolygon p, int minFloors, int
 		}
 
 	}
+	info.offset(origin);
 	std::clock_t end = clock();
 	double elapsed_secs = double(end - begin) / CLOCKS_PER_SEC;
 	//FString res = FString();
@@ -287,6 +341,117 @@ FPlotInfo APlotBuilder::generateHousePolygons(FPlotPolygon p, int minFloors, int
 }
 
 
+void APlotBuilder::benchmarkFootprints(int32 footprints) {
+	// footprints of 4 to 8 corners around a circle, like the houses coming out of refine
+	FRandomStream stream(footprints);
+	TArray<FPolygon> shapes;
+	shapes.SetNum(footprints);
+	for (FPolygon &shape : shapes) {
+		int32 corners = stream.RandRange(4, 8);
+		float radius = stream.FRandRange(1000, 4000);
+		for (int32 i = 0; i < corners; i++) {
+			float angle = (i + stream.FRandRange(-0.3f, 0.3f)) * 2 * PI / corners;
+			shape.points.Add(FVector(FMath::Cos(angle), FMath::Sin(angle), 0) * radius * stream.FRandRange(0.8f, 1.0f));
+		}
+	}
+
+	// results are summed so the work can't be skipped
+	double sum3D = 0;
+	double begin = FPlatformTime::Seconds();
+	for (const FPolygon &shape : shapes) {
+		FPolygon p = shape;
+		sum3D += p.getArea() + p.getCenter().X;
+		SplitStruct split = p.getSplitProposal(true, 0.5);
+		p.symmetricShrink(100, false);
+		p.clipEdges(-0.96f);
+		sum3D += split.p1.X + p.points.Num();
+	}
+	double time3D = FPlatformTime::Seconds() - begin;
+
+	double sum2D = 0;
+	begin = FPlatformTime::Seconds();
+	for (const FPolygon &shape : shapes) {
+		FPolygon2D p = shape.to2D();
+		sum2D += p.getArea() + p.getCenter().X;
+		SplitStruct split = p.getSplitProposal(true, 0.5);
+		p.symmetricShrink(100, false);
+		p.clipEdges(-0.96f);
+		sum2D += split.p1.X + p.points.Num();
+	}
+	double time2D = FPlatformTime::Seconds() - begin;
+
+	UE_LOG(LogTemp, Warning, TEXT("time to process %i footprints as FPolygon: %f, as FPolygon2D: %f, speedup %f, results %f and %f"), footprints, time3D, time2D, time3D / std::max(time2D, 0.000001), sum3D, sum2D);
+}
+
+// clipEdges the way it was before it compacted the points, removing them one at a time
+static void clipEdgesPointByPoint(FPolygon &p, float maxDot) {
+	TArray<FVector> &points = p.points;
+	bool removed = true;
+	while (removed) {
+		removed = false;
+		for (int32 i = 1; i < points.Num() + 1; i++) {
+			if (FVector::DistSquared(points[i - 1], points[i%points.Num()]) < 100.0f) {
+				points.RemoveAt(i%points.Num());
+				removed = true;
+				break;
+			}
+		}
+	}
+	for (int32 i = 1; i < points.Num(); i++) {
+		FVector tan1 = points[i] - points[i - 1];
+		FVector tan2 = points[(i + 1) % points.Num()] - points[i];
+		tan1.Normalize();
+		tan2.Normalize();
+		if (FVector::DotProduct(tan1, tan2) < maxDot && points.Num() > 3) {
+			points.RemoveAt((i + 1) % points.Num());
+			i--;
+		}
+	}
+}
+
+void APlotBuilder::benchmarkClipEdges(int32 blocks, int32 corners) {
+	FRandomStream stream(blocks + corners);
+	TArray<FPolygon> shapes;
+	shapes.SetNum(blocks);
+	for (FPolygon &shape : shapes) {
+		int32 num = stream.RandRange(3, corners);
+		float radius = stream.FRandRange(5000, 50000);
+		for (int32 i = 0; i < num; i++) {
+			float angle = i * 2 * PI / num;
+			FVector point = FVector(FMath::Cos(angle), FMath::Sin(angle), 0) * radius;
+			float kind = stream.FRand();
+			if (kind < 0.2f && i > 0)
+				// close to the point before it
+				point = shape.points[i - 1] + FVector(stream.FRandRange(-8, 8), stream.FRandRange(-8, 8), 0);
+			else if (kind < 0.3f)
+				// a spike out of the block
+				point *= stream.FRandRange(1.5f, 3.0f);
+			else
+				point += FVector(stream.FRandRange(-20, 20), stream.FRandRange(-20, 20), 0);
+			shape.points.Add(point);
+		}
+	}
+
+	TArray<FPolygon> clipped = shapes;
+	double begin = FPlatformTime::Seconds();
+	for (FPolygon &p : clipped)
+		p.clipEdges(-0.96f);
+	double timeCompacted = FPlatformTime::Seconds() - begin;
+
+	TArray<FPolygon> reference = shapes;
+	begin = FPlatformTime::Seconds();
+	for (FPolygon &p : reference)
+		clipEdgesPointByPoint(p, -0.96f);
+	double timePointByPoint = FPlatformTime::Seconds() - begin;
+
+	int32 differing = 0;
+	for (int32 i = 0; i < blocks; i++) {
+		if (clipped[i].points != reference[i].points)
+			differing++;
+	}
+	UE_LOG(LogTemp, Warning, TEXT("time to clip %i blocks compacted: %f, point by point: %f, speedup %f, %i results differ"), blocks, timeCompacted, timePointByPoint, timePointByPoint / std::max(timeCompacted, 0.000001), differing);
+}
+
 TArray<FMaterialPolygon> APlotBuilder::getSideWalkPolygons(FPlotPolygon p, float width) {
 	TArray<FMaterialPolygon> pols;
 	FVector prevP1 = FVector(0,0,0);
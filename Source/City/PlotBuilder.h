@@ -4,6 +4,7 @@
 
 #include "GameFramework/Actor.h"
 #include "HouseBuilder.h"
+#include "NoiseContext.h"
 //#include "BaseLibrary.h"
 #include "PlotBuilder.generated.h"
 
@@ -32,12 +33,24 @@ public:
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = meshes, meta = (AllowPrivateAccess = "true"))
 		float noiseHeightInfluence = 0.0;
 
+	// noise used for house heights, the global noise is used until one is set
+	FNoiseContext noiseContext;
+	bool hasNoiseContext = false;
+
+	UFUNCTION(BlueprintCallable, Category = "Generation")
+		void setNoiseContext(FNoiseContext context) { noiseContext = context; hasNoiseContext = true; }
+	FNoiseContext getNoiseContext();
+
 	UFUNCTION(BlueprintCallable, Category = "Generation")
 	static TArray<FMetaPolygon> sanityCheck(TArray<FMetaPolygon> plots, TArray<FPolygon> others);
 
 	UFUNCTION(BlueprintCallable, Category = "Generation")
 	FPlotInfo generateHousePolygons(FPlotPolygon p, int minFloors, int maxFloors);
 
+	// generates all plots at once spread over the task threads, houses and leftovers come in the same order as the plots
+	UFUNCTION(BlueprintCallable, Category = "Generation")
+	FPlotInfo generateAllHousePolygons(TArray<FPlotPolygon> plots, int minFloors, int maxFloors);
+
 	UFUNCTION(BlueprintCallable, Category = "Generation")
 	static FPolygon generateSidewalkPolygon(FPlotPolygon p, float offsetSize);
 	
@@ -54,10 +67,22 @@ public:
 	UFUNCTION(BlueprintCallable, Category = "Generation")
 	static FCityDecoration getCityDecoration(TArray<FMetaPolygon> plots, TArray<FPolygon> roads);
 
+	// runs area, center, split, shrink and clipping on random house footprints as FPolygon and as FPolygon2D, logs the time for both
+	UFUNCTION(BlueprintCallable, Category = "Test")
+	static void benchmarkFootprints(int32 footprints = 100000);
+
+	// clips random blocks with many corners, some of them close together or sticking out, with clipEdges and with the old point by point
+	// removal, logs how many results differ and the time for both
+	UFUNCTION(BlueprintCallable, Category = "Test")
+	static void benchmarkClipEdges(int32 blocks = 200, int32 corners = 2000);
+
 protected:
 	// Called when the game starts or when spawned
 	virtual void BeginPlay() override;
 	//virtual void BeginDestroy() override;
+
+	// subdivides, places and decorates a single plot, only reads from the builder so several plots can be generated at once
+	FPlotInfo generatePlot(FPlotPolygon p, int minFloors, int maxFloors, const FNoiseContext &noise) const;
 public:	
 	// Called every frame
 	virtual void Tick(float DeltaTime) override;
@@ -47,21 +47,10 @@ AProcMeshActor::~AProcMeshActor()
 
 
 
-bool AProcMeshActor::buildPolygons(TArray<FPolygon> &pols, FVector offset, URuntimeMeshComponent* mesh, UMaterialInterface *mat) {
-	if (mesh->GetNumSections() > 0 || pols.Num() == 0) {
-		return false;
-	}
-
-	TArray<FVector> vertices;
-	TArray<int32> triangles;
-	TArray<FVector2D> UV;
-	TArray<FVector> normals;
-
-	TArray<FColor> vertexColors;
-	TArray<FRuntimeMeshTangent> tangents;
-
-	int current = 0;
-	for (FPolygon &pol : pols) {
+// triangulates the polygons and appends them to the arrays
+static void triangulate(const TArray<FPolygon> &pols, float texScaleMultiplier, TArray<FVector> &vertices, TArray<int32> &triangles, TArray<FVector2D> &UV, TArray<FVector> &normals) {
+	int current = vertices.Num();
+	for (const FPolygon &pol : pols) {
 
 		if (pol.points.Num() < 3)
 			continue;
@@ -102,9 +91,44 @@ bool AProcMeshActor::buildPolygons(TArray<FPolygon> &pols, FVector offset, URunt
 		}
 		current += pol.points.Num();
 	}
+}
 
+bool AProcMeshActor::buildPolygons(TArray<FPolygon> &pols, FVector offset, URuntimeMeshComponent* mesh, UMaterialInterface *mat, const TArray<FloorCopies> &copies) {
+	if (mesh->GetNumSections() > 0 || (pols.Num() == 0 && copies.Num() == 0)) {
+		return false;
+	}
 
+	TArray<FVector> vertices;
+	TArray<int32> triangles;
+	TArray<FVector2D> UV;
+	TArray<FVector> normals;
+
+	TArray<FColor> vertexColors;
+	TArray<FRuntimeMeshTangent> tangents;
+
+	triangulate(pols, texScaleMultiplier, vertices, triangles, UV, normals);
+
+	// a repeated floor is only triangulated once, then its vertices are copied into the section for every height it's at, so the section is as large as with every floor built by itself.
+	// moving it up doesn't change its uvs, they're relative to its first point
+	for (const FloorCopies &floor : copies) {
+		TArray<FVector> floorVertices;
+		TArray<int32> floorTriangles;
+		TArray<FVector2D> floorUV;
+		TArray<FVector> floorNormals;
+		triangulate(floor.pols, texScaleMultiplier, floorVertices, floorTriangles, floorUV, floorNormals);
+		for (float height : floor.offsets) {
+			int32 first = vertices.Num();
+			for (const FVector &vertex : floorVertices)
+				vertices.Add(vertex + FVector(0, 0, height));
+			for (int32 index : floorTriangles)
+				triangles.Add(first + index);
+			UV.Append(floorUV);
+			normals.Append(floorNormals);
+		}
+	}
 
+	if (vertices.Num() == 0)
+		return false;
 
 	mesh->SetMaterial(0, mat);
 	mesh->CreateMeshSection(0, vertices, triangles, normals, UV, vertexColors, tangents, proceduralMeshesCollision, EUpdateFrequency::Infrequent);
@@ -134,16 +158,7 @@ bool AProcMeshActor::clearMeshes(bool fullReplacement) {
 }
 
 
-// divides the polygon into the different materials used by the house
-bool AProcMeshActor::buildMaterialPolygons(TArray<FMaterialPolygon> pols, FVector offset) {
-	if (isWorking) {
-		clearMeshes(true);
-		isWorking = false;
-		workersWorking--;
-
-		//return false;
-	}
-
+TArray<TArray<FPolygon>> AProcMeshActor::sortByMaterial(const TArray<FMaterialPolygon> &pols) {
 	TArray<FPolygon> exterior;
 	TArray<FPolygon> exteriorSnd;
 
@@ -160,7 +175,7 @@ bool AProcMeshActor::buildMaterialPolygons(TArray<FMaterialPolygon> pols, FVecto
 
 	TArray<FPolygon> roadMiddle;
 	TArray<FPolygon> asphalt;
-	for (FMaterialPolygon &p : pols) {
+	for (const FMaterialPolygon &p : pols) {
 		switch (p.type) {
 		case PolygonType::exterior:
 			exterior.Add(p);
@@ -203,19 +218,34 @@ bool AProcMeshActor::buildMaterialPolygons(TArray<FMaterialPolygon> pols, FVecto
 	}
 
 
-	polygons.Empty();
-	polygons.Add(exterior);
-	polygons.Add(exteriorSnd);
-	polygons.Add(interior);
-	polygons.Add(windows);
-	polygons.Add(windowFrames);
-	polygons.Add(occlusionWindows);
-	polygons.Add(floors);
-	polygons.Add(roofs);
-	polygons.Add(green);
-	polygons.Add(concrete);
-	polygons.Add(roadMiddle);
-	polygons.Add(asphalt);
+	TArray<TArray<FPolygon>> sorted;
+	sorted.Add(exterior);
+	sorted.Add(exteriorSnd);
+	sorted.Add(interior);
+	sorted.Add(windows);
+	sorted.Add(windowFrames);
+	sorted.Add(occlusionWindows);
+	sorted.Add(floors);
+	sorted.Add(roofs);
+	sorted.Add(green);
+	sorted.Add(concrete);
+	sorted.Add(roadMiddle);
+	sorted.Add(asphalt);
+	return sorted;
+}
+
+// divides the polygon into the different materials used by the house
+bool AProcMeshActor::buildMaterialPolygons(TArray<FMaterialPolygon> pols, FVector offset) {
+	if (isWorking) {
+		clearMeshes(true);
+		isWorking = false;
+		workersWorking--;
+
+		//return false;
+	}
+	polygons = sortByMaterial(pols);
+	floorCopies.Empty();
+	floorCopies.SetNum(polygons.Num());
 
 	components.Empty();
 	components.Add(exteriorMesh);
@@ -276,6 +306,19 @@ bool AProcMeshActor::buildMaterialPolygons(TArray<FMaterialPolygon> pols, FVecto
 }
 
 
+bool AProcMeshActor::buildHouseMeshes(TArray<FMaterialPolygon> pols, TArray<FFloorChunk> floors) {
+	bool res = buildMaterialPolygons(pols, FVector(0, 0, 0));
+	// the floors end up in the same section as the rest of their material, so the house keeps one component per material however tall it is
+	for (const FFloorChunk &chunk : floors) {
+		TArray<TArray<FPolygon>> sorted = sortByMaterial(chunk.pols);
+		for (int32 i = 0; i < sorted.Num(); i++) {
+			if (sorted[i].Num() > 0)
+				floorCopies[i].Add(FloorCopies{ MoveTemp(sorted[i]), chunk.offsets });
+		}
+	}
+	return res;
+}
+
 // Called when the game starts or when spawned
 void AProcMeshActor::BeginPlay()
 {
@@ -283,6 +326,16 @@ void AProcMeshActor::BeginPlay()
 	
 }
 
+void AProcMeshActor::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	// give back the slot if removed halfway through building
+	if (isWorking) {
+		isWorking = false;
+		workersWorking--;
+	}
+	Super::EndPlay(EndPlayReason);
+}
+
 // Called every frame
 void AProcMeshActor::Tick(float DeltaTime)
 {
@@ -294,9 +347,11 @@ void AProcMeshActor::Tick(float DeltaTime)
 	}
 
 	if (isWorking) {
-		TArray<FPolygon> &current = polygons[currentlyWorkingArray];
-		buildPolygons(current, FVector(0, 0, 0), components[currentlyWorkingArray], materials[currentlyWorkingArray]);
-		currentlyWorkingArray++;
+		if (currentlyWorkingArray < polygons.Num()) {
+			TArray<FPolygon> &current = polygons[currentlyWorkingArray];
+			buildPolygons(current, FVector(0, 0, 0), components[currentlyWorkingArray], materials[currentlyWorkingArray], floorCopies[currentlyWorkingArray]);
+			currentlyWorkingArray++;
+		}
 		if (currentlyWorkingArray >= polygons.Num()) {
 			isWorking = false;
 			workersWorking--;
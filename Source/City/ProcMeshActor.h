@@ -25,6 +25,12 @@ public:
 	UFUNCTION(BlueprintCallable, Category = "Generation")
 	bool buildMaterialPolygons(TArray<FMaterialPolygon> pols, FVector offset);
 
+	// builds the polygons like buildMaterialPolygons, every floor chunk is triangulated once and its vertices are copied to all the floors it's at.
+	// this only saves the triangulation, the sections still hold the vertices of every floor, as many as if each floor had been built by itself.
+	// showing one copy of the vertices at every floor would need a component or instance per floor, which costs more in draw calls than it saves
+	UFUNCTION(BlueprintCallable, Category = "Generation")
+	bool buildHouseMeshes(TArray<FMaterialPolygon> pols, TArray<FFloorChunk> floors);
+
 	bool clearMeshes(bool fullReplacement);
 
 	UFUNCTION(BlueprintCallable, Category = "Settings")
@@ -69,13 +75,22 @@ public:
 protected:
 	// Called when the game starts or when spawned
 	virtual void BeginPlay() override;
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
 
 public:	
 	// Called every frame
 	virtual void Tick(float DeltaTime) override;
 
 private:
-	bool buildPolygons(TArray<FPolygon> &pols, FVector offset, URuntimeMeshComponent* mesh, UMaterialInterface *mat);
+	// the polygons of one material in a floor chunk and the heights they're shown at
+	struct FloorCopies {
+		TArray<FPolygon> pols;
+		TArray<float> offsets;
+	};
+
+	bool buildPolygons(TArray<FPolygon> &pols, FVector offset, URuntimeMeshComponent* mesh, UMaterialInterface *mat, const TArray<FloorCopies> &copies);
+	// one array per material, in the same order as components and materials
+	TArray<TArray<FPolygon>> sortByMaterial(const TArray<FMaterialPolygon> &pols);
 
 
 	bool wantsToWork = false;
@@ -113,6 +128,9 @@ private:
 	TArray<UMaterialInterface*> materials;
 	TArray<TArray<FPolygon>> polygons;
 
+	// the floor chunks of the house per material, built with the polygons of the same material
+	TArray<TArray<FloorCopies>> floorCopies;
+
 	int currIndex = 1;
 	
 	
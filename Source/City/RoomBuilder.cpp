@@ -327,7 +327,7 @@ TArray<FMaterialPolygon> ARoomBuilder::interiorPlanToPolygons(TArray<FRoomPolygo
 				doorStart = FVector::Dist(rp->points[i - 1], entrancePos) - 137/2;
 				doorEnd = doorStart + 137;
 				// 2 1 4 3
-				auto entH = getEntranceHole(rp->points[i - 1], rp->points[i%rp->points.Num()], floorHeight, 297, 137, entrancePos);
+				const FPolygon entH = getEntranceHole(rp->points[i - 1], rp->points[i%rp->points.Num()], floorHeight, 297, 137, entrancePos);
 				newP.points.EmplaceAt(2, entH[1]);
 				newP.points.EmplaceAt(3, entH[0]);
 				newP.points.EmplaceAt(4, entH[3]);
@@ -377,10 +377,10 @@ TArray<FMaterialPolygon> ARoomBuilder::interiorPlanToPolygons(TArray<FRoomPolygo
 								FMaterialPolygon sidePol;
 								sidePol.width = 0;
 								sidePol.type = PolygonType::exterior;
-								sidePol += p[k - 1];
-								sidePol += p[k%p.points.Num()];
-								sidePol += p[k%p.points.Num()] + p.getDirection() * 20;
-								sidePol += p[k - 1] + p.getDirection() * 20;
+								sidePol += p.points[k - 1];
+								sidePol += p.points[k%p.points.Num()];
+								sidePol += p.points[k%p.points.Num()] + p.getDirection() * 20;
+								sidePol += p.points[k - 1] + p.getDirection() * 20;
 								toReturn.Add(sidePol);
 							}
 						}
@@ -424,7 +424,7 @@ static void attemptPlaceAroundPolygon(FPolygon center, FString itemName, TArray<
 }
 
 
-bool attemptPlaceOnTop(FMeshInfo toUse, TArray<FMeshInfo> &meshes, FString name, float minDist, TMap<FString, UHierarchicalInstancedStaticMeshComponent*> map) {
+bool attemptPlaceOnTop(FMeshInfo toUse, TArray<FMeshInfo> &meshes, FString name, float minDist, TMap<FString, UHierarchicalInstancedStaticMeshComponent*> map, FRandomStream &stream) {
 	FVector min;
 	FVector max;
 	if (map.Contains(toUse.description))
@@ -436,7 +436,7 @@ bool attemptPlaceOnTop(FMeshInfo toUse, TArray<FMeshInfo> &meshes, FString name,
 	pol.points.Add(FVector(max.X, min.Y, 0.0f) + toUse.transform.GetLocation());
 	pol.points.Add(FVector(max.X, max.Y, 0.0f) + toUse.transform.GetLocation());
 	pol.points.Add(FVector(min.X, max.Y, 0.0f) + toUse.transform.GetLocation());
-	FVector res = pol.getRandomPoint(true, minDist);
+	FVector res = pol.getRandomPoint(true, minDist, stream);
 	if (res.X != 0.0f) {
 		meshes.Add(FMeshInfo{ name, FTransform{FRotator(0,0,0), res + FVector(0,0,max.Z)}});
 		return true;
@@ -521,7 +521,7 @@ static TArray<FMeshInfo> placeAwnings(FRoomPolygon *r2, TMap<FString, UHierarchi
 
 
 
-static TArray<FMeshInfo> potentiallyGetTableAndChairs(FRoomPolygon *r2, TArray<FPolygon> &placed, TMap<FString, UHierarchicalInstancedStaticMeshComponent*> &map) {
+static TArray<FMeshInfo> potentiallyGetTableAndChairs(FRoomPolygon *r2, TArray<FPolygon> &placed, TMap<FString, UHierarchicalInstancedStaticMeshComponent*> &map, FRandomStream &stream) {
 	TArray<FMeshInfo> meshes;
 	//FRoomInfo r;
 
@@ -541,14 +541,14 @@ static TArray<FMeshInfo> potentiallyGetTableAndChairs(FRoomPolygon *r2, TArray<F
 		attemptPlaceAroundPolygon(tableP, "chair", placed, meshes, FRotator(0, 0, 0), map, 0.007, *r2);
 
 		if (FMath::FRand() < 0.35)
-			attemptPlaceOnTop(table, meshes, "kettle", 50, map);
+			attemptPlaceOnTop(table, meshes, "kettle", 50, map, stream);
 	}
 
 	return meshes;
 
 }
 
-static FRoomInfo getLivingRoom(FRoomPolygon *r2, TMap<FString, UHierarchicalInstancedStaticMeshComponent*> &map) {
+static FRoomInfo getLivingRoom(FRoomPolygon *r2, TMap<FString, UHierarchicalInstancedStaticMeshComponent*> &map, FRandomStream &stream) {
 	FRoomInfo r;
 	TArray<FPolygon> placed;
 	placed.Append(getBlockingVolumes(r2, 200, 200));
@@ -564,7 +564,7 @@ static FRoomInfo getLivingRoom(FRoomPolygon *r2, TMap<FString, UHierarchicalInst
 		}
 
 	}
-	r.meshes.Append(potentiallyGetTableAndChairs(r2, placed, map));
+	r.meshes.Append(potentiallyGetTableAndChairs(r2, placed, map, stream));
 
 	return r;
 }
@@ -644,26 +644,26 @@ static FRoomInfo getHallWay(FRoomPolygon *r2, TMap<FString, UHierarchicalInstanc
 	return r;
 }
 
-static FRoomInfo getKitchen(FRoomPolygon *r2, TMap<FString, UHierarchicalInstancedStaticMeshComponent*> &map) {
+static FRoomInfo getKitchen(FRoomPolygon *r2, TMap<FString, UHierarchicalInstancedStaticMeshComponent*> &map, FRandomStream &stream) {
 	FRoomInfo r;
 	TArray<FPolygon> placed;
 
 	placed.Append(getBlockingVolumes(r2, 200, 100));
 	r2->attemptPlace(placed, r.meshes, false, 2, "kitchen", FRotator(0, 0, 0), FVector(0, 0, 0), map, true);
-	r.meshes.Append(potentiallyGetTableAndChairs(r2, placed, map));
+	r.meshes.Append(potentiallyGetTableAndChairs(r2, placed, map, stream));
 	r2->attemptPlace(placed, r.meshes, false, 1, "shelf_upper_large", FRotator(0, 270, 0), FVector(0, 0, 200), map, false);
 	r2->attemptPlace(placed, r.meshes, false, 1, "fridge", FRotator(0, 90, 0), FVector(0, 0, 0), map, true);
 	r2->attemptPlace(placed, r.meshes, false, 1, "oven", FRotator(0, 270, 0), FVector(0, 0, 0), map, true);
 	return r;
 }
 
-static FRoomInfo getCorridor(FRoomPolygon *r2, TMap<FString, UHierarchicalInstancedStaticMeshComponent*> &map) {
+static FRoomInfo getCorridor(FRoomPolygon *r2, TMap<FString, UHierarchicalInstancedStaticMeshComponent*> &map, FRandomStream &stream) {
 	FRoomInfo r;
 	TArray<FPolygon> placed;
 	placed.Append(getBlockingVolumes(r2, 200, 100));
 	r2->attemptPlace(placed, r.meshes, false, 1, "locker", FRotator(0, 0, 0), FVector(0, 0, 0), map, true);
 	if (r.meshes.Num() == 1 && FMath::FRand() < 0.2) {
-		attemptPlaceOnTop(r.meshes[0], r.meshes, "vase", 50, map);
+		attemptPlaceOnTop(r.meshes[0], r.meshes, "vase", 50, map, stream);
 
 	}
 	r2->attemptPlace(placed, r.meshes, false, 1, "wardrobe", FRotator(0, 0, 0), FVector(0, 0, 10), map, true);
@@ -776,17 +776,17 @@ FRoomInfo ARoomBuilder::placeBalcony(FRoomPolygon *p, int place, TMap<FString, U
 
 	return r;
 }
-void ARoomBuilder::buildSpecificRoom(FRoomInfo &r, FRoomPolygon *r2, TMap<FString, UHierarchicalInstancedStaticMeshComponent*> &map) {
+void ARoomBuilder::buildSpecificRoom(FRoomInfo &r, FRoomPolygon *r2, TMap<FString, UHierarchicalInstancedStaticMeshComponent*> &map, FRandomStream &stream) {
 	switch (r2->type) {
-	case SubRoomType::living: r.append(getLivingRoom(r2, map));
+	case SubRoomType::living: r.append(getLivingRoom(r2, map, stream));
 		break;
 	case SubRoomType::bed: r.append(getBedRoom(r2, map));
 		break;
 	case SubRoomType::closet: r.append(getCloset(r2, map));
 		break;
-	case SubRoomType::corridor:	r.append(getCorridor(r2, map));
+	case SubRoomType::corridor:	r.append(getCorridor(r2, map, stream));
 		break;
-	case SubRoomType::kitchen: r.append(getKitchen(r2, map));
+	case SubRoomType::kitchen: r.append(getKitchen(r2, map, stream));
 		break;
 	case SubRoomType::bath: r.append(getBathRoom(r2, map));
 		break;
@@ -1,6 +1,8 @@
 #include "City.h"
 #include "NoiseSingleton.h"
+#include "simplexnoise.h"
 #include "Spawner.h"
+#include "Async/ParallelFor.h"
 #include <ctime>
 
 
@@ -14,48 +16,8 @@ ASpawner::ASpawner()
 
 
 
-int convertToMapIndex(int x, int y) {
-	return x * 10000 + y;
-}
-
-
-
-void addRoadToMap(TMap <int, TArray<FRoadSegment*>*> &map, FRoadSegment* current, float intervalLength) {
-	FVector middle = (current->p2 - current->p1) / 2 + current->p1;
-	int x = FMath::RoundToInt((middle.X / intervalLength));
-	int y = FMath::RoundToInt((middle.Y / intervalLength));
-	for (int i = -1; i <= 1; i++) {
-		for (int j = -1; j <= 1; j++) {
-			if (map.Find(convertToMapIndex(i+x, j+y)) == nullptr) {
-				TArray<FRoadSegment*>* newArray = new TArray<FRoadSegment*>();
-				newArray->Add(current);
-				map.Emplace(convertToMapIndex(i+x, j+y), newArray);
-			}
-			else {
-				map[convertToMapIndex(i+x, j+y)]->Add(current);
-			}
-		}
-	}
-
-}
-
-TArray<TArray<FRoadSegment*>*> getRelevantSegments(TMap <int, TArray<FRoadSegment*>*> &map, FRoadSegment* current, float intervalLength) {
-	TArray<TArray<FRoadSegment*>*> allInteresting;
-	FVector middle = (current->p2 - current->p1) / 2 + current->p1;
-	int x = FMath::RoundToInt((middle.X / intervalLength));
-	int y = FMath::RoundToInt((middle.Y / intervalLength));
-
-	for (int i = -1; i <= 1; i++) {
-		for (int j = -1; j <= 1; j++) {
-			if (map.Find(convertToMapIndex(i+x, j+y)) != nullptr) {
-				allInteresting.Add(map[convertToMapIndex(i+x, j+y)]);
-			}
-		}
-	}
-
-	return allInteresting;
-
-}
+// roads whose middles are closer than this are not allowed
+const float minRoadMiddleDistance = 4000;
 
 
 void ASpawner::addVertices(FRoadSegment* road) {
@@ -69,7 +31,7 @@ void ASpawner::addVertices(FRoadSegment* road) {
 }
 
 
-void ASpawner::collideInto(FRoadSegment *s1, FRoadSegment *s2, FVector impactP) {
+bool ASpawner::collideInto(FRoadSegment *s1, const FRoadSegment *s2, FVector impactP) {
 	//FVector tangent2 = impactP - f2->p1;
 	//tangent2.Normalize();
 	s1->p2 = impactP;// f2->p1 + (len - standardWidth / 2) * tangent;
@@ -82,6 +44,7 @@ void ASpawner::collideInto(FRoadSegment *s1, FRoadSegment *s2, FVector impactP)
 	pot2.Normalize();
 
 	FVector potentialNewTangent;
+	bool blocking = false;
 	if (FVector::Dist(pot1, naturalTangent) < FVector::Dist(pot2, naturalTangent))//(FVector::DotProduct(pot1, naturalTangent) > 0.7)
 		potentialNewTangent = pot1;
 	else
@@ -98,376 +61,621 @@ void ASpawner::collideInto(FRoadSegment *s1, FRoadSegment *s2, FVector impactP)
 		s1->v3 = s2->v4;
 		s1->v4 = s2->v3;
 		s1->p2 = middle(s2->v4, s2->v3);
-		s2->roadInFront = true;
+		blocking = true;
 	}
 	
 	s1->roadInFront = true;
+	return blocking;
 }
 
-bool ASpawner::placementCheck(TArray<FRoadSegment*> &segments, logicRoadSegment* current, TMap <int, TArray<FRoadSegment*>*> &map){
+static FBox2D getBounds(FVector p1, FVector p2, float margin) {
+	return FBox2D(FVector2D(std::min(p1.X, p2.X) - margin, std::min(p1.Y, p2.Y) - margin), FVector2D(std::max(p1.X, p2.X) + margin, std::max(p1.Y, p2.Y) + margin));
+}
 
-	// use SAT collision between all roads
-	FVector tangent1 = current->segment->p2 - current->segment->p1;
-	tangent1.Normalize();
-	FVector tangent2 = FRotator(0, 90, 0).RotateVector(tangent1);
+void ASpawner::evaluatePlacement(const RoadGrowth &growth, int32 currentIndex, PlacementResult &result){
+
+	const logicRoadSegment &current = growth.pool[currentIndex];
+	const FRoadSegment* previousSegment = current.previous != INDEX_NONE ? &growth.pool[current.previous].segment : nullptr;
+	result.accepted = true;
+	result.collided = false;
+	result.blocked.Reset();
+	result.placedCount = growth.placed.Num();
+	// stays invalid if the road is turned down before looking at any other road
+	result.searched.Init();
+	result.segment = current.segment;
+	FRoadSegment &segment = result.segment;
+	addVertices(&segment);
+
+	if (growth.bounded && !growth.bounds.IsInside(FVector2D(segment.p2))) {
+		result.accepted = false;
+		return;
+	}
 
-	addVertices(current->segment);
-	TArray<FVector> vert1;
-	vert1.Add(current->segment->v1);
-	vert1.Add(current->segment->v2);
-	vert1.Add(current->segment->v3);
-	vert1.Add(current->segment->v4);
+	// only roads in the grid cells around the new one can be too close to it or intersect it, they come back in placement order so collisions are resolved the same way as when checking every road
+	TArray<int32> nearby;
+	growth.grid.query(segment.p1, segment.p2, minRoadMiddleDistance, nearby);
+	result.searched = getBounds(segment.p1, segment.p2, minRoadMiddleDistance);
 
-	for (FRoadSegment* f : segments){
-		if (f == current->previous->segment)
+	for (int32 n = 0; n < nearby.Num(); n++){
+		const FRoadSegment* f = &growth.pool[growth.placed[nearby[n]]].segment;
+		if (f == previousSegment)
 			continue; 
-		
-		TArray<FVector> tangents;
-
 
-
-
-		FVector tangent3 = f->p2 - f->p1;
-		FVector tangent4 = FRotator(0, 90, 0).RotateVector(tangent3);
-
-		tangent1.Normalize();
-		tangent2.Normalize();
-		tangent3.Normalize();
-		tangent4.Normalize();
 		// can't be too close to another segment
-		bool closeMiddle = FVector::Dist((f->p2 + f->p1) / 2, (current->segment->p2 + current->segment->p1) / 2) < 4000;
-		//bool closeOtherEnd = FVector::Dist(f->p2, current->segment->p2) < 3000;
+		bool closeMiddle = FVector::Dist((f->p2 + f->p1) / 2, (segment.p2 + segment.p1) / 2) < minRoadMiddleDistance;
 		if (closeMiddle) {
-			return false;
+			result.accepted = false;
+			return;
 		}
-		//if (closeOtherEnd && FVector::DotProduct(tangent3, tangent1) < -0.8f){
-		//	return false;
-		//}
-
-		tangents.Add(tangent1);
-		tangents.Add(tangent2);
-		tangents.Add(tangent3);
-		tangents.Add(tangent4);
-
-		TArray<FVector> vert2;
-		vert2.Add(f->v1);
-		vert2.Add(f->v2);
-		vert2.Add(f->v3);
-		vert2.Add(f->v4);
-
-		//if (testCollision(tangents, vert1, vert2, collisionLeniency)) {
-		FVector newE = intersection(current->segment->p1, current->segment->p2, f->p1, f->p2);
-		if (newE.X != 0) {
-			current->time = 100000;
-			collideInto(current->segment, f, newE);
+
+		SegmentHit newE = intersection(segment.p1, segment.p2, f->p1, f->p2);
+		if (newE.hit) {
+			result.collided = true;
+			if (collideInto(&segment, f, newE.point))
+				result.blocked.Add(nearby[n]);
+
+			// the end of the road can move outside of the area we looked at, so look again around the new road for the roads not yet tested
+			int32 last = nearby[n];
+			growth.grid.query(segment.p1, segment.p2, minRoadMiddleDistance, nearby);
+			result.searched += getBounds(segment.p1, segment.p2, minRoadMiddleDistance);
+			n = 0;
+			while (n < nearby.Num() && nearby[n] <= last)
+				n++;
+			n--;
 		}
 
+	}
+
+	// running into another road can move the end as well
+	if (growth.bounded && !growth.bounds.IsInside(FVector2D(segment.p2)))
+		result.accepted = false;
 
+}
 
-		//}
+bool ASpawner::isStillValid(const RoadGrowth &growth, const PlacementResult &result) {
+	// roads placed after the check only change its outcome if they are inside the area it looked at, a check that didn't look at any can't change
+	if (!result.searched.bIsValid)
+		return true;
+	for (int32 i = result.placedCount; i < growth.placed.Num(); i++) {
+		const FRoadSegment &f = growth.pool[growth.placed[i]].segment;
+		if (getBounds(f.p1, f.p2, 1.0f).Intersect(result.searched))
+			return false;
+	}
+	return true;
+}
 
+bool ASpawner::placementCheck(RoadGrowth &growth, int32 currentIndex, PlacementResult &result){
+	logicRoadSegment &current = growth.pool[currentIndex];
+	current.segment = result.segment;
+	if (result.collided)
+		current.time = 100000;
+	// roads we ran into are blocked in front even if we end up not being placed
+	for (int32 blocked : result.blocked)
+		growth.pool[growth.placed[blocked]].segment.roadInFront = true;
+	return result.accepted;
+}
 
+void ASpawner::speculatePlacements(RoadGrowth &growth, TMap<int32, PlacementResult> &speculated) {
+	// the start of the heap holds the roads that will be popped soon
+	TArray<int32> batch;
+	for (const roadQueueEntry &entry : growth.queue.entries()) {
+		if (batch.Num() >= speculativeBatchSize)
+			break;
+		PlacementResult* previous = speculated.Find(entry.index);
+		if (!previous || !isStillValid(growth, *previous))
+			batch.Add(entry.index);
 	}
 
-	return true;
-	
+	TArray<PlacementResult> results;
+	results.SetNum(batch.Num());
+	int32 numTasks = std::min(roadThreads, batch.Num());
+	ParallelFor(numTasks, [&](int32 task) {
+		for (int32 i = task; i < batch.Num(); i += numTasks) {
+			evaluatePlacement(growth, batch[i], results[i]);
+		}
+	});
 
+	for (int32 i = 0; i < batch.Num(); i++) {
+		speculated.Add(batch[i], MoveTemp(results[i]));
+	}
 }
 
-float getValueOfRotation(FVector testPoint, TArray<logicRoadSegment*> &others, float maxDist, float detriment) {
-	float val = NoiseSingleton::getInstance()->noise(testPoint.X, testPoint.Y);//noise(noiseScale, testPoint.X, testPoint.Y);
-	for (logicRoadSegment* t : others) {
-		if (FVector::Dist(t->segment->getMiddle(), testPoint) < maxDist)
-			val -= std::max(0.0f, detriment * (maxDist - FVector::Dist(t->segment->getMiddle(), testPoint))/maxDist);
+void ASpawner::growRoads(RoadGrowth &growth, int32 maxSegments) {
+	// placement checks done ahead of time by the worker threads, by pool index
+	TMap<int32, PlacementResult> speculated;
+	PlacementResult result;
+
+	while (growth.queue.size() > 0 && growth.placed.Num() < maxSegments) {
+		int32 current = growth.queue.top().index;
+		if (roadThreads > 1 && !speculated.Contains(current))
+			speculatePlacements(growth, speculated);
+		growth.queue.pop();
+
+		// roads are still committed one at a time in queue order, a check made ahead of time is only used if nothing placed since could have changed it
+		PlacementResult* ahead = speculated.Find(current);
+		if (ahead && isStillValid(growth, *ahead))
+			result = MoveTemp(*ahead);
+		else
+			evaluatePlacement(growth, current, result);
+		speculated.Remove(current);
+
+		if (placementCheck(growth, current, result)){/// && FVector::Dist(current->segment->p1, current->segment->p2) > 2000) {
+			logicRoadSegment &currentL = growth.pool[current];
+			growth.placed.Add(current);
+			if (currentL.previous != INDEX_NONE && FVector::Dist(growth.pool[currentL.previous].segment.p2, currentL.segment.p1) < 1.0f)
+				growth.pool[currentL.previous].segment.roadInFront = true;
+			growth.grid.add(growth.placed.Num() - 1, currentL.segment.p1, currentL.segment.p2);
+
+			addExtensions(growth, current);
+		}
 	}
+}
+
+float getValueOfRotation(FVector testPoint, const FNoiseContext &noise, const RepulsionField *mainRoads) {
+	float val = noise.noise(testPoint.X, testPoint.Y);
+	if (mainRoads)
+		val -= mainRoads->sample(testPoint);
 	return val;
 }
 
 
 
-FRotator getBestRotation(float maxDiffAllowed, FRotator original, FVector originalPoint, FVector step, TArray<logicRoadSegment*> &others, float maxDist, float detriment) {
-	FVector testPoint = originalPoint + original.RotateVector(step);
+FRotator getBestRotation(float maxDiffAllowed, FRotator original, FVector originalPoint, FVector step, const FNoiseContext &noise, const RepulsionField *mainRoads) {
+	const int32 tries = 7;
+	// draw all rotations first so the noise for them can be read in one go, the stream is used in the same order as before
+	FRotator rotations[tries];
+	FVector testPoints[tries];
+	float xs[tries];
+	float ys[tries];
+	float noises[tries];
+	for (int i = 0; i < tries; i++) {
+		rotations[i] = original + FRotator(0, baseLibraryStream.FRandRange(-maxDiffAllowed, maxDiffAllowed), 0);
+		testPoints[i] = originalPoint + rotations[i].RotateVector(step);
+		xs[i] = testPoints[i].X;
+		ys[i] = testPoints[i].Y;
+	}
+	noise.noise(xs, ys, noises, tries);
+
 	float bestVal = -10000;
 	FRotator bestRotator = original;
-	for (int i = 0; i < 7; i++) {
-		FRotator curr = original + FRotator(0, baseLibraryStream.FRandRange(-maxDiffAllowed, maxDiffAllowed), 0);
-		testPoint = originalPoint + curr.RotateVector(step);
-		float val = getValueOfRotation(testPoint, others, maxDist, detriment);
+	for (int i = 0; i < tries; i++) {
+		float val = noises[i];
+		if (mainRoads)
+			val -= mainRoads->sample(testPoints[i]);
 		if (val > bestVal) {
-			bestRotator = curr;
-			bestVal = NoiseSingleton::getInstance()->noise(testPoint.X, testPoint.Y);
+			bestRotator = rotations[i];
+			bestVal = noises[i];
 		}
 	}
 	return bestRotator;
 }
 
-void ASpawner::addRoadForward(std::priority_queue<logicRoadSegment*, std::deque<logicRoadSegment*>, roadComparator> &queue, logicRoadSegment* previous, std::vector<logicRoadSegment*> &allsegments) {
-	FRoadSegment* prevSeg = previous->segment;
-	logicRoadSegment* newRoadL = new logicRoadSegment();
-	FRoadSegment* newRoad = new FRoadSegment();
-	FVector stepLength = prevSeg->type == RoadType::main ? primaryStepLength : secondaryStepLength;
+void ASpawner::addRoadForward(RoadGrowth &growth, int32 previousIndex) {
+	// add first, references into the pool are only taken after it has grown
+	int32 index = growth.pool.Add(logicRoadSegment());
+	logicRoadSegment &previous = growth.pool[previousIndex];
+	logicRoadSegment &newRoadL = growth.pool[index];
+	FRoadSegment &prevSeg = previous.segment;
+	FRoadSegment &newRoad = newRoadL.segment;
+	FVector stepLength = prevSeg.type == RoadType::main ? primaryStepLength : secondaryStepLength;
 
-	newRoad->p1 = prevSeg->p2;
+	newRoad.p1 = prevSeg.p2;
 
-	TArray<logicRoadSegment*> others;
-	if (prevSeg->type == RoadType::main) {
-		for (logicRoadSegment* f : allsegments) {
-			if (f->segment->type == RoadType::main) {
-				others.Add(f);
-			}
-		}
-	}
+	// only main roads are pushed away from other main roads
+	const RepulsionField *others = prevSeg.type == RoadType::main ? &growth.mainRoads : nullptr;
 
 
-	FRotator bestRotator = getBestRotation((prevSeg->type == RoadType::main ? changeIntensity : secondaryChangeIntensity), previous->rotation,newRoad->p1, stepLength, others, mainRoadDetrimentRange, mainRoadDetrimentImpact);
+	FRotator bestRotator = getBestRotation((prevSeg.type == RoadType::main ? changeIntensity : secondaryChangeIntensity), previous.rotation,newRoad.p1, stepLength, growth.noise, others);
 
-	newRoadL->rotation = bestRotator;
+	newRoadL.rotation = bestRotator;
 
 
-	newRoad->p2 = newRoad->p1 + newRoadL->rotation.RotateVector(stepLength);
-	newRoad->beginTangent = prevSeg->p2 - prevSeg->p1;
-	newRoad->beginTangent.Normalize();
-	newRoad->width = prevSeg->width;
-	newRoad->type = prevSeg->type;
-	newRoad->endTangent = newRoad->p2 - newRoad->p1;
-	newRoadL->segment = newRoad;
-	float val = getValueOfRotation(newRoad->p2, others, mainRoadDetrimentRange, mainRoadDetrimentImpact);
-	newRoadL->time = -val + ((newRoad->type == RoadType::main) ? mainRoadAdvantage : 0) + std::abs(0.1*previous->time);// + baseLibraryStream.FRand() * 0.1;
-	newRoadL->roadLength = previous->roadLength + 1;
-	newRoadL->previous = previous;
-	addVertices(newRoad);
-	queue.push(newRoadL);
-	allsegments.push_back(newRoadL);
+	newRoad.p2 = newRoad.p1 + newRoadL.rotation.RotateVector(stepLength);
+	newRoad.beginTangent = prevSeg.p2 - prevSeg.p1;
+	newRoad.beginTangent.Normalize();
+	newRoad.width = prevSeg.width;
+	newRoad.type = prevSeg.type;
+	newRoad.endTangent = newRoad.p2 - newRoad.p1;
+	float val = getValueOfRotation(newRoad.p2, growth.noise, others);
+	newRoadL.time = -val + ((newRoad.type == RoadType::main) ? mainRoadAdvantage : 0) + std::abs(0.1*previous.time);// + baseLibraryStream.FRand() * 0.1;
+	newRoadL.roadLength = previous.roadLength + 1;
+	newRoadL.previous = previousIndex;
+	addVertices(&newRoad);
+	growth.queue.push({ newRoadL.time, index });
+	if (newRoad.type == RoadType::main)
+		growth.mainRoads.add(newRoad.getMiddle());
 	
 }
 
-void ASpawner::addRoadSide(std::priority_queue<logicRoadSegment*, std::deque<logicRoadSegment*>, roadComparator> &queue, logicRoadSegment* previous, bool left, float width, std::vector<logicRoadSegment*> &allsegments, RoadType newType) {
-	FRoadSegment* prevSeg = previous->segment;
-	logicRoadSegment* newRoadL = new logicRoadSegment();
-	FRoadSegment* newRoad = new FRoadSegment();
+void ASpawner::addRoadSide(RoadGrowth &growth, int32 previousIndex, bool left, float width, RoadType newType) {
+	int32 index = growth.pool.Add(logicRoadSegment());
+	logicRoadSegment &previous = growth.pool[previousIndex];
+	logicRoadSegment &newRoadL = growth.pool[index];
+	FRoadSegment &prevSeg = previous.segment;
+	FRoadSegment &newRoad = newRoadL.segment;
 	FVector stepLength = newType == RoadType::main ? primaryStepLength : secondaryStepLength;
 
 	FRotator newRotation = left ? FRotator(0, 90, 0) : FRotator(0, 270, 0);
-	newRoadL->rotation = previous->rotation + newRotation;
-	FVector startOffset = newRoadL->rotation.RotateVector(FVector(standardWidth*previous->segment->width / 2, 0, 0));
-	newRoad->p1 =prevSeg->p1 + (prevSeg->p2 - prevSeg->p1) / 2 + startOffset;
+	newRoadL.rotation = previous.rotation + newRotation;
+	FVector startOffset = newRoadL.rotation.RotateVector(FVector(standardWidth*prevSeg.width / 2, 0, 0));
+	newRoad.p1 =prevSeg.p1 + (prevSeg.p2 - prevSeg.p1) / 2 + startOffset;
 
 
-	TArray<logicRoadSegment*> others;
-	if (newType == RoadType::main) {
-		for (logicRoadSegment* f : allsegments) {
-			if (f->segment->type == RoadType::main) {
-				others.Add(f);
-			}
-		}
-	}
-	FRotator bestRotator = getBestRotation(secondaryChangeIntensity, newRoadL->rotation, newRoad->p1, stepLength, others, mainRoadDetrimentRange, mainRoadDetrimentImpact);
-	newRoadL->rotation = bestRotator;
+	const RepulsionField *others = newType == RoadType::main ? &growth.mainRoads : nullptr;
+	FRotator bestRotator = getBestRotation(secondaryChangeIntensity, newRoadL.rotation, newRoad.p1, stepLength, growth.noise, others);
+	newRoadL.rotation = bestRotator;
 
 
-	newRoad->p2 = newRoad->p1 + newRoadL->rotation.RotateVector(stepLength);
-	newRoad->beginTangent = FRotator(0, left ? 90 : 270, 0).RotateVector(previous->segment->p2 - previous->segment->p1); //->p2 - newRoad->p1;
-	newRoad->beginTangent.Normalize();
-	newRoad->width = width;
-	newRoad->type = newType;
-	newRoad->endTangent = newRoad->p2 - newRoad->p1;
+	newRoad.p2 = newRoad.p1 + newRoadL.rotation.RotateVector(stepLength);
+	newRoad.beginTangent = FRotator(0, left ? 90 : 270, 0).RotateVector(prevSeg.p2 - prevSeg.p1); //->p2 - newRoad->p1;
+	newRoad.beginTangent.Normalize();
+	newRoad.width = width;
+	newRoad.type = newType;
+	newRoad.endTangent = newRoad.p2 - newRoad.p1;
 
-	newRoadL->segment = newRoad;
 	// every side track has less priority
 
 	//FVector mP = middle(newRoad->p1, newRoad->p2);
-	float val = getValueOfRotation(newRoad->p2, others, mainRoadDetrimentRange, mainRoadDetrimentImpact);
-	newRoadL->time = -val + ((newRoad->type == RoadType::main) ? mainRoadAdvantage : 0) + std::abs(0.1*previous->time);// + baseLibraryStream.FRand() * 0.1;
+	float val = getValueOfRotation(newRoad.p2, growth.noise, others);
+	newRoadL.time = -val + ((newRoad.type == RoadType::main) ? mainRoadAdvantage : 0) + std::abs(0.1*previous.time);// + baseLibraryStream.FRand() * 0.1;
 
-	newRoadL->roadLength = (previous->segment->type == RoadType::main && newType != RoadType::main) ? 1 : previous->roadLength+1;
-	newRoadL->previous = previous;
+	newRoadL.roadLength = (prevSeg.type == RoadType::main && newType != RoadType::main) ? 1 : previous.roadLength+1;
+	newRoadL.previous = previousIndex;
 
-	addVertices(newRoad);
-	queue.push(newRoadL);
-	allsegments.push_back(newRoadL);
+	addVertices(&newRoad);
+	growth.queue.push({ newRoadL.time, index });
+	if (newRoad.type == RoadType::main)
+		growth.mainRoads.add(newRoad.getMiddle());
 
 }
 
-void ASpawner::addExtensions(std::priority_queue<logicRoadSegment*, std::deque<logicRoadSegment*>, roadComparator> &queue, logicRoadSegment* current, std::vector<logicRoadSegment*> &allsegments) {
+void ASpawner::addExtensions(RoadGrowth &growth, int32 currentIndex) {
 	float mainRoadSize = 4.0f;
 	float sndRoadMinSize = 1.9f;
-	float sndRoadSize = std::max(sndRoadMinSize, current->segment->width - 1.5f);
-	FVector tangent = current->segment->p2 - current->segment->p1;
-	if (current->segment->type == RoadType::main) {
+	// copy what we need, the pool can move while the new roads are added
+	RoadType type = growth.pool[currentIndex].segment.type;
+	int roadLength = growth.pool[currentIndex].roadLength;
+	float sndRoadSize = std::max(sndRoadMinSize, growth.pool[currentIndex].segment.width - 1.5f);
+	if (type == RoadType::main) {
 		// on the main road
-		if (current->roadLength < maxMainRoadLength)
-			addRoadForward(queue, current, allsegments);
+		if (roadLength < maxMainRoadLength)
+			addRoadForward(growth, currentIndex);
 
 		if (baseLibraryStream.FRandRange(0, 1) < mainRoadBranchChance)
-			addRoadSide(queue, current, true, mainRoadSize, allsegments, RoadType::main);
+			addRoadSide(growth, currentIndex, true, mainRoadSize, RoadType::main);
 		else
-			addRoadSide(queue, current, true, sndRoadSize, allsegments, RoadType::secondary);
+			addRoadSide(growth, currentIndex, true, sndRoadSize, RoadType::secondary);
 		if (baseLibraryStream.FRandRange(0, 1) < mainRoadBranchChance)
-			addRoadSide(queue, current, false, mainRoadSize, allsegments, RoadType::main);
+			addRoadSide(growth, currentIndex, false, mainRoadSize, RoadType::main);
 		else 
-			addRoadSide(queue, current, false, sndRoadSize, allsegments, RoadType::secondary);
+			addRoadSide(growth, currentIndex, false, sndRoadSize, RoadType::secondary);
 
 	}
 
-	else if (current->segment->type == RoadType::secondary) {
+	else if (type == RoadType::secondary) {
 		// side road
-		if (current->roadLength < maxSecondaryRoadLength) {
-			addRoadForward(queue, current, allsegments);
+		if (roadLength < maxSecondaryRoadLength) {
+			addRoadForward(growth, currentIndex);
 
-			addRoadSide(queue, current, true, sndRoadSize, allsegments, RoadType::secondary);
-			addRoadSide(queue, current, false, sndRoadSize, allsegments, RoadType::secondary);
+			addRoadSide(growth, currentIndex, true, sndRoadSize, RoadType::secondary);
+			addRoadSide(growth, currentIndex, false, sndRoadSize, RoadType::secondary);
 		}
 	}
 
 
 }
 
-TArray<FRoadSegment> ASpawner::determineRoadSegments()
-{
-
-	std::clock_t begin = clock();
+void ASpawner::findAttachment(const RoadGrowth &growth, const RoadSegmentGrid *changed, int32 i, AttachResult &result) {
+	const FRoadSegment &f2 = growth.pool[growth.placed[i]].segment;
+	FVector tangent = f2.p2 - f2.p1;
+	tangent.Normalize();
+	FVector p2Prev = f2.p2;
+	FVector extended = f2.p2 + tangent*maxAttachDistance;
+	float closestDist = 10000000.0f;
+	result.closest = INDEX_NONE;
+
+	// the grid has every road where it was placed, roads moved since then are found through changed
+	TArray<int32> nearby;
+	growth.grid.query(p2Prev, extended, 1.0f, nearby);
+	if (changed) {
+		TArray<int32> moved;
+		changed->query(p2Prev, extended, 1.0f, moved);
+		nearby.Append(moved);
+		nearby.Sort();
+	}
 
+	for (int32 n = 0; n < nearby.Num(); n++) {
+		int32 j = nearby[n];
+		if (i == j || (n > 0 && nearby[n - 1] == j)) {
+			continue;
+		}
+		const FRoadSegment &f = growth.pool[growth.placed[j]].segment;
+		SegmentHit res = intersection(p2Prev, extended, f.p1, f.p2);
+		if (res.hit && FVector::Dist(p2Prev, res.point) < closestDist) {
+			closestDist = FVector::Dist(p2Prev, res.point);
+			result.closest = j;
+			result.impact = res.point;
+		}
+	}
+}
 
+void ASpawner::attachRoads(RoadGrowth &growth) {
+	int32 num = growth.placed.Num();
+
+	// look for a road in front of every dangling road on all threads, against the roads as they were placed
+	TArray<AttachResult> found;
+	found.SetNum(num);
+	ParallelFor(num, [&](int32 i) {
+		if (!growth.pool[growth.placed[i]].segment.roadInFront)
+			findAttachment(growth, nullptr, i, found[i]);
+	});
+
+	// roads are attached in order on this thread, since attaching a road moves its end. if a road moved earlier in this pass
+	// is close to the extended road the lookup is made again, so the result is the same as attaching them one by one
+	RoadSegmentGrid changed(growth.grid.getCellSize());
+	for (int32 i = 0; i < num; i++) {
+		FRoadSegment* f2 = &growth.pool[growth.placed[i]].segment;
+		if (f2->roadInFront)
+			continue;
+		FVector tangent = f2->p2 - f2->p1;
+		tangent.Normalize();
+		FVector p2Prev = f2->p2;
+		TArray<int32> moved;
+		changed.query(p2Prev, f2->p2 + tangent*maxAttachDistance, 1.0f, moved);
+		if (moved.Num() > 0)
+			findAttachment(growth, &changed, i, found[i]);
+
+		if (found[i].closest != INDEX_NONE) {
+			FRoadSegment* closest = &growth.pool[growth.placed[found[i].closest]].segment;
+			if (collideInto(f2, closest, found[i].impact))
+				closest->roadInFront = true;
+			changed.add(i, f2->p1, p2Prev);
+			changed.add(i, f2->p1, f2->p2);
+		}
+	}
+}
 
+void ASpawner::initNoise() {
 	// set the common random stream
 	baseLibraryStream = stream;
-		NoiseSingleton::getInstance()->setNoiseScale(noiseScale);
 
+	// every chunk sets up its noise again, the cache is kept as long as the noise and its settings stay the same
+	FNoiseContext previous = noiseContext;
 	if (useTexture) {
-		NoiseSingleton::getInstance()->setUseTexture(noiseTexture, noiseTextureScale);
-		NoiseSingleton::getInstance()->initForImage();
+		// the texture only has to be decoded once
+		bool decoded = decodedTexture == noiseTexture && noiseContext.heatmap.IsValid();
+		noiseContext = FNoiseContext::makeImage(noiseScale, noiseTexture, noiseTextureScale, bilinearTexture, decoded ? noiseContext.heatmap : nullptr);
+		decodedTexture = noiseTexture;
 	}
 	else {
-		NoiseSingleton::getInstance()->initForPerlin(baseLibraryStream.RandRange(-10000, 10000), baseLibraryStream.RandRange(-10000, 10000));
+		noiseContext = FNoiseContext::makePerlin(noiseScale, baseLibraryStream.RandRange(-10000, 10000), baseLibraryStream.RandRange(-10000, 10000));
 	}
+	if (cacheNoise)
+		noiseContext = noiseContext.withCache(noiseCacheTiles, noiseCacheTileSize, noiseCacheResolution, noiseOctaves, 2.0f, 0.5f, &previous);
+	// for anything still reading the global noise
+	NoiseSingleton::getInstance()->setContext(noiseContext);
 
 	// if we have no roof it looks better with polygons on side of walls as well, otherwise the top side of walls in the buildings will just be empty
 	BaseLibrary::overrideSides = !generateRoofs;
+	BaseLibrary::localCoordinates = localCoordinates;
+}
+
+void ASpawner::addStartRoad(RoadGrowth &growth, FVector point, FRotator rotation) {
+	int32 startIndex = growth.pool.Add(logicRoadSegment());
+	logicRoadSegment &start = growth.pool[startIndex];
+	start.time = -10000;
+	FRoadSegment &startR = start.segment;
+	startR.p1 = point;
+	startR.p2 = startR.p1 + rotation.RotateVector(primaryStepLength);
+	startR.width = 4.0f;
+	startR.type = RoadType::main;
+	startR.endTangent = startR.p2 - startR.p1;
+	startR.endTangent.Normalize();
+	startR.beginTangent = startR.endTangent;
+	start.rotation = rotation;
+	start.roadLength = 1;
+	addVertices(&startR);
+
+	growth.queue.push({ start.time, startIndex });
+}
+
+TArray<FRoadSegment> ASpawner::finishRoads(RoadGrowth &growth) {
+	// make sure roads attach properly if there is another road not too far in front of them
+	attachRoads(growth);
 
-	FVector origin;
-	TArray<FRoadSegment*> determinedSegments;
+	// the pool goes away with the growth, so the placed roads can be moved out of it
 	TArray<FRoadSegment> finishedSegments;
+	finishedSegments.Reserve(growth.placed.Num());
+	for (int32 index : growth.placed) {
+		finishedSegments.Add(MoveTemp(growth.pool[index].segment));
+	}
+	return finishedSegments;
+}
 
+TArray<FRoadSegment> ASpawner::determineRoadSegments()
+{
 
-	std::priority_queue<logicRoadSegment*, std::deque<logicRoadSegment*>, roadComparator> queue;
+	std::clock_t begin = clock();
 
+	initNoise();
 
-	std::vector<logicRoadSegment*> allSegments;
-	logicRoadSegment* start = new logicRoadSegment();
-	start->time = -10000;
-	FRoadSegment* startR = new FRoadSegment();
+	// grid of placed roads for faster comparisons, cells are about as big as a main road segment
+	RoadGrowth growth(std::max(primaryStepLength.Size(), minRoadMiddleDistance), mainRoadDetrimentRange, mainRoadDetrimentImpact);
+	growth.noise = noiseContext;
+	// every placed road proposes at most three new ones, so the pool never has to grow during generation
+	growth.pool.Reserve(3 * length + 1);
+	growth.placed.Reserve(length);
 
 	FVector point = FVector(0, 0, 0);
 
-	startR->p1 = point;
-
+	// start in the direction with the highest noise
+	float xs[360];
+	float ys[360];
+	float noises[360];
+	for (int i = 0; i < 360; i++) {
+		FVector testPoint = point + FRotator(0, i, 0).RotateVector(primaryStepLength);
+		xs[i] = testPoint.X;
+		ys[i] = testPoint.Y;
+	}
+	growth.noise.noise(xs, ys, noises, 360);
 
-	start->segment = startR;
 	float bestVal = -1000000;
 	FRotator bestRot;
 	for (int i = 0; i < 360; i++) {
-		FVector testPoint = point + FRotator(0, i, 0).RotateVector(primaryStepLength);
-		float testVal = NoiseSingleton::getInstance()->noise(testPoint.X, testPoint.Y);
-		if (testVal > bestVal) {
-			bestVal = testVal;
+		if (noises[i] > bestVal) {
+			bestVal = noises[i];
 			bestRot = FRotator(0, i, 0);
 		}
 	}
-	startR->p2 = startR->p1 + bestRot.RotateVector(primaryStepLength);
-	startR->width = 4.0f;
-	startR->type = RoadType::main;
-	startR->endTangent = startR->p2 - startR->p1;
-	startR->endTangent.Normalize();
-	startR->beginTangent = startR->endTangent;
-	start->rotation = bestRot;
-	start->roadLength = 1;
-	addVertices(startR);
+	addStartRoad(growth, point, bestRot);
 
-	queue.push(start);
+	// loop for everything else
+	growRoads(growth, length);
 
-	// map for faster comparisons, unused currently
-	TMap <int, TArray<FRoadSegment*>*> segmentsOrganized;
+	TArray<FRoadSegment> finishedSegments = finishRoads(growth);
 
-	// loop for everything else
+	std::clock_t end = clock();
+	double elapsed_secs = double(end - begin) / CLOCKS_PER_SEC;
+	UE_LOG(LogTemp, Warning, TEXT("time to generate road segments: %f"), elapsed_secs);
 
-	while (queue.size() > 0 && determinedSegments.Num() < length) {
-		logicRoadSegment* current = queue.top();
-		queue.pop();
-		if (placementCheck(determinedSegments, current, segmentsOrganized)){/// && FVector::Dist(current->segment->p1, current->segment->p2) > 2000) {
-			determinedSegments.Add(current->segment);
-			if (current->previous && FVector::Dist(current->previous->segment->p2, current->segment->p1) < 1.0f)
-				current->previous->segment->roadInFront = true;
-			//addRoadToMap(segmentsOrganized, current->segment, primaryStepLength.Size() / 2);
 
-			addExtensions(queue, current, allSegments);
-		}
-	}
+	return finishedSegments;
+}
 
+void ASpawner::benchmarkRoadGeneration(int32 maxSegments) {
+	int32 originalLength = length;
+	for (int32 n = 1000; n <= maxSegments; n *= 2) {
+		length = n;
+		std::clock_t begin = clock();
+		TArray<FRoadSegment> segments = determineRoadSegments();
+		std::clock_t end = clock();
+		double elapsed_secs = double(end - begin) / CLOCKS_PER_SEC;
+		UE_LOG(LogTemp, Warning, TEXT("time to generate %i road segments: %f, per segment: %f"), segments.Num(), elapsed_secs, elapsed_secs / std::max(1, segments.Num()));
+	}
+	length = originalLength;
+}
 
+FVector ASpawner::getChunkOrigin(FIntPoint chunk) {
+	return FVector(chunk.X * chunkSize, chunk.Y * chunkSize, 0);
+}
 
-	// make sure roads attach properly if there is another road not too far in front of them
-	for (int k = 0; k < 1; k++) {
-		for (int i = 0; i < determinedSegments.Num(); i++) {
-			FRoadSegment* f2 = determinedSegments[i];
-			if (f2->roadInFront)
-				continue;
-			FVector tangent = f2->p2 - f2->p1;
-			tangent.Normalize();
-			FVector p2Prev = f2->p2;
-			FVector p1Prev = f2->p1;
-			f2->p2 += tangent*maxAttachDistance;
-			float closestDist = 10000000.0f;
-			FRoadSegment* closest = nullptr;
-			FVector impactP;
-			for (int j = 0; j < determinedSegments.Num(); j++) {
-				FRoadSegment* f = determinedSegments[j];
-				if (i == j) {
-					continue;
-				}
-
-				FVector fTan = f->p2 - f->p1;
-				fTan.Normalize();
-				FVector res = intersection(p2Prev, f2->p2, f->p1, f->p2);
-				if (res.X != 0.0f && FVector::Dist(p2Prev, res) < closestDist) {
-					closestDist = FVector::Dist(p2Prev, res);
-					closest = f;
-					impactP = res;
-				}
-			}
-			if (closest) {
-				collideInto(f2, closest, impactP);
-			}
-			else {
-				f2->p2 = p2Prev;
-			}
-		}
+FIntPoint ASpawner::getChunkAt(FVector location) {
+	return FIntPoint(FMath::FloorToInt(location.X / chunkSize), FMath::FloorToInt(location.Y / chunkSize));
+}
 
+int32 ASpawner::getChunkSeed(FIntPoint chunk) {
+	return HashCombine(GetTypeHash(stream.GetInitialSeed()), GetTypeHash(chunk));
+}
 
+void ASpawner::addGateRoads(RoadGrowth &growth, FIntPoint edge, bool alongY, bool inwardPositive) {
+	// a gate is a main road starting on a chunk border. the gates of a border only depend on the border itself,
+	// so the chunks on both sides start roads from the same points and their networks connect there
+	FRandomStream edgeStream(HashCombine(getChunkSeed(edge), alongY ? 1 : 2));
+	FVector corner = getChunkOrigin(edge);
+	FVector along = alongY ? FVector(0, chunkSize, 0) : FVector(chunkSize, 0, 0);
+	float inwardYaw = alongY ? (inwardPositive ? 0 : 180) : (inwardPositive ? 90 : 270);
+	FRotator rotation = FRotator(0, inwardYaw - primaryStepLength.Rotation().Yaw, 0);
+	for (int32 i = 0; i < chunkGatesPerEdge; i++) {
+		// spread out along the border, away from the corners
+		float pos = (i + edgeStream.FRandRange(0.25f, 0.75f)) / chunkGatesPerEdge;
+		addStartRoad(growth, corner + along * pos, rotation);
 	}
+}
 
+TArray<FRoadSegment> ASpawner::determineChunkRoadSegments(FIntPoint chunk) {
+	std::clock_t begin = clock();
 
-	TArray<int> keys;
-	segmentsOrganized.GetKeys(keys);
-	UE_LOG(LogTemp, Warning, TEXT("deleting %i keys in map"), keys.Num());
-	for (int key : keys) {
-		delete(segmentsOrganized[key]);
-	}
+	// the noise is shared by all chunks, everything else random in the chunk comes from its own seed
+	initNoise();
+	baseLibraryStream = FRandomStream(getChunkSeed(chunk));
 
-	for (FRoadSegment* f : determinedSegments) {
-		finishedSegments.Add(*f);
-	}
+	RoadGrowth growth(std::max(primaryStepLength.Size(), minRoadMiddleDistance), mainRoadDetrimentRange, mainRoadDetrimentImpact);
+	growth.noise = noiseContext;
+	growth.pool.Reserve(3 * chunkLength + 4 * chunkGatesPerEdge);
+	growth.placed.Reserve(chunkLength);
+	// roads have to end a bit inside the chunk, so they never overlap roads from the neighbours
+	FVector origin = getChunkOrigin(chunk);
+	float margin = minRoadMiddleDistance / 2;
+	growth.bounds = FBox2D(FVector2D(origin.X + margin, origin.Y + margin), FVector2D(origin.X + chunkSize - margin, origin.Y + chunkSize - margin));
+	growth.bounded = true;
 
-	for (logicRoadSegment* s : allSegments){
-		delete(s->segment);
-		delete(s);
-	}
+	addGateRoads(growth, chunk, true, true);
+	addGateRoads(growth, FIntPoint(chunk.X + 1, chunk.Y), true, false);
+	addGateRoads(growth, chunk, false, true);
+	addGateRoads(growth, FIntPoint(chunk.X, chunk.Y + 1), false, false);
+
+	growRoads(growth, chunkLength);
+
+	TArray<FRoadSegment> finishedSegments = finishRoads(growth);
 
 	std::clock_t end = clock();
 	double elapsed_secs = double(end - begin) / CLOCKS_PER_SEC;
-	UE_LOG(LogTemp, Warning, TEXT("time to generate road segments: %f"), elapsed_secs);
+	UE_LOG(LogTemp, Warning, TEXT("time to generate road segments for chunk %i, %i: %f"), chunk.X, chunk.Y, elapsed_secs);
+	return finishedSegments;
+}
 
+TArray<FMetaPolygon> ASpawner::getChunkSurroundingPolygons(FIntPoint chunk, TArray<FRoadSegment> segments) {
+	// the chunk border works as a road without width, closing off the blocks at the edge of the chunk.
+	// the neighbour closes its own blocks along the same line so they line up
+	FVector origin = getChunkOrigin(chunk);
+	FVector corners[4] = { origin, origin + FVector(chunkSize, 0, 0), origin + FVector(chunkSize, chunkSize, 0), origin + FVector(0, chunkSize, 0) };
+	for (int32 i = 0; i < 4; i++) {
+		FRoadSegment border;
+		border.p1 = corners[i];
+		border.p2 = corners[(i + 1) % 4];
+		border.width = 0.0f;
+		border.type = RoadType::secondary;
+		border.beginTangent = border.p2 - border.p1;
+		border.beginTangent.Normalize();
+		border.endTangent = border.beginTangent;
+		border.roadInFront = true;
+		addVertices(&border);
+		segments.Add(border);
+	}
+	if (!BaseLibrary::localCoordinates)
+		return BaseLibrary::getSurroundingPolygons(segments, segments, standardWidth, extraLen, extraBlockingLen, 50, 100);
+
+	// the blocks are found around the chunk origin and moved back out after
+	for (FRoadSegment &segment : segments) {
+		segment.p1 -= origin;
+		segment.p2 -= origin;
+		segment.v1 -= origin;
+		segment.v2 -= origin;
+		segment.v3 -= origin;
+		segment.v4 -= origin;
+	}
+	TArray<FMetaPolygon> blocks = BaseLibrary::getSurroundingPolygons(segments, segments, standardWidth, extraLen, extraBlockingLen, 50, 100);
+	for (FMetaPolygon &block : blocks)
+		block.offset(origin);
+	return blocks;
+}
 
-	return finishedSegments;
+static bool sameSegment(const FRoadSegment &a, const FRoadSegment &b) {
+	return a.p1 == b.p1 && a.p2 == b.p2 && a.width == b.width && a.beginTangent == b.beginTangent && a.endTangent == b.endTangent
+		&& a.type == b.type && a.v1 == b.v1 && a.v2 == b.v2 && a.v3 == b.v3 && a.v4 == b.v4 && a.roadInFront == b.roadInFront;
+}
+
+void ASpawner::benchmarkParallelRoadGeneration() {
+	int32 originalThreads = roadThreads;
+	roadThreads = 1;
+	std::clock_t begin = clock();
+	TArray<FRoadSegment> serial = determineRoadSegments();
+	double serialSecs = double(clock() - begin) / CLOCKS_PER_SEC;
+	UE_LOG(LogTemp, Warning, TEXT("time to generate %i road segments serially: %f"), serial.Num(), serialSecs);
+
+	for (int32 threads = 2; threads <= 32; threads *= 2) {
+		roadThreads = threads;
+		// clock() would add up the time of all threads, so measure wall time here
+		double start = FPlatformTime::Seconds();
+		TArray<FRoadSegment> parallel = determineRoadSegments();
+		double elapsed_secs = FPlatformTime::Seconds() - start;
+		bool identical = parallel.Num() == serial.Num();
+		for (int32 i = 0; identical && i < serial.Num(); i++) {
+			identical = sameSegment(serial[i], parallel[i]);
+		}
+		UE_LOG(LogTemp, Warning, TEXT("time to generate road segments with %i threads: %f, speedup: %f, identical to serial: %s"), threads, elapsed_secs, serialSecs / elapsed_secs, identical ? TEXT("yes") : TEXT("no"));
+	}
+	roadThreads = originalThreads;
 }
 
 TArray<FMaterialPolygon> ASpawner::getRoadLines(TArray<FRoadSegment> segments)
@@ -538,22 +746,80 @@ TArray<FMaterialPolygon> ASpawner::roadPolygonsToMaterialPolygons(TArray<FPolygo
 
 TArray<FTransform> ASpawner::visualizeNoise(int numSide, float noiseMultiplier, float posMultiplier) {
 	TArray<FTransform> toReturn;
+	TArray<float> xs;
+	TArray<float> ys;
 	for (int i = -numSide/2; i < numSide/2; i++) {
 		for (int j = -numSide/2; j < numSide/2; j++) {
-			FTransform f;
-			f.SetLocation(FVector(posMultiplier * i, posMultiplier * j, 0));
-			float res = NoiseSingleton::getInstance()->noise(f.GetLocation().X, f.GetLocation().Y);
-
-			f.SetScale3D(FVector(posMultiplier/100, posMultiplier/100,  res* posMultiplier/10));
-			toReturn.Add(f);
+			xs.Add(posMultiplier * i);
+			ys.Add(posMultiplier * j);
 		}
 	}
+	TArray<float> res;
+	res.SetNumUninitialized(xs.Num());
+	noiseContext.noise(xs.GetData(), ys.GetData(), res.GetData(), xs.Num());
+
+	for (int32 i = 0; i < xs.Num(); i++) {
+		FTransform f;
+		f.SetLocation(FVector(xs[i], ys[i], 0));
+		f.SetScale3D(FVector(posMultiplier/100, posMultiplier/100,  res[i]* posMultiplier/10));
+		toReturn.Add(f);
+	}
 	return toReturn;
 }
 
 
 
 
+void ASpawner::benchmarkNoise(int32 points) {
+	TArray<float> xs;
+	TArray<float> ys;
+	TArray<float> scalarRes;
+	TArray<float> vectorRes;
+	xs.SetNumUninitialized(points);
+	ys.SetNumUninitialized(points);
+	scalarRes.SetNumUninitialized(points);
+	vectorRes.SetNumUninitialized(points);
+	FRandomStream pointStream(points);
+	for (int32 i = 0; i < points; i++) {
+		xs[i] = pointStream.FRandRange(-1000000, 1000000);
+		ys[i] = pointStream.FRandRange(-1000000, 1000000);
+	}
+	const FNoiseContext &noise = noiseContext;
+
+	double begin = FPlatformTime::Seconds();
+	for (int32 i = 0; i < points; i++)
+		scalarRes[i] = noise.noise(xs[i], ys[i]);
+	double single = FPlatformTime::Seconds() - begin;
+
+	begin = FPlatformTime::Seconds();
+	noise.noise(xs.GetData(), ys.GetData(), scalarRes.GetData(), points, false);
+	double scalar = FPlatformTime::Seconds() - begin;
+
+	begin = FPlatformTime::Seconds();
+	noise.noise(xs.GetData(), ys.GetData(), vectorRes.GetData(), points, true);
+	double vectorized = FPlatformTime::Seconds() - begin;
+
+	int32 mismatches = 0;
+	for (int32 i = 0; i < points; i++) {
+		if (scalarRes[i] != vectorRes[i])
+			mismatches++;
+	}
+	UE_LOG(LogTemp, Warning, TEXT("noise points per second, one at a time: %f, scalar batch: %f, vectorized batch: %f (vector instructions used: %i), mismatches: %i"),
+		points / single, points / scalar, points / vectorized, SimplexNoise::isVectorized(), mismatches);
+}
+
+void ASpawner::logNoiseCacheStats() {
+	if (!noiseContext.cache.IsValid()) {
+		UE_LOG(LogTemp, Warning, TEXT("noise cache not in use"));
+		return;
+	}
+	FNoiseTileCache &cache = *noiseContext.cache;
+	int64 total = cache.getHits() + cache.getMisses();
+	UE_LOG(LogTemp, Warning, TEXT("noise cache hits: %lld, misses: %lld, evictions: %lld, hit rate: %f, tiles: %i"),
+		cache.getHits(), cache.getMisses(), cache.getEvictions(), total > 0 ? double(cache.getHits()) / total : 0.0, cache.getTileCount());
+	cache.resetCounters();
+}
+
 TArray<FMetaPolygon> ASpawner::getSurroundingPolygons(TArray<FRoadSegment> segments)
 {
 	return BaseLibrary::getSurroundingPolygons(segments, segments, standardWidth, extraLen, extraBlockingLen, 50, 100);
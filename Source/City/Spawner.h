@@ -3,6 +3,7 @@
 #include "GameFramework/Actor.h"
 //#include "BaseLibrary.h"
 #include "PlotBuilder.h"
+#include "NoiseContext.h"
 #include "Spawner.generated.h"
 
 
@@ -19,6 +20,45 @@ struct FVisualizer{
 
 };
 
+// outcome of checking a proposed road against the placed ones. kept apart from the pool so proposals can be checked ahead of time on other threads
+struct PlacementResult {
+	bool accepted = false;
+	// whether the road ran into another one and was shortened
+	bool collided = false;
+	// the road after running into others
+	FRoadSegment segment;
+	// positions in placed of roads that now have this road in front of them
+	TArray<int32> blocked;
+	// how many roads were placed when the check was made, and the area it looked at
+	int32 placedCount = 0;
+	FBox2D searched;
+};
+
+// the closest road in front of a dangling road, as a position in RoadGrowth::placed
+struct AttachResult {
+	int32 closest = INDEX_NONE;
+	FVector impact;
+};
+
+// everything needed while growing one road network, roads refer to each other by their index in the pool
+struct RoadGrowth {
+	RoadGrowth(float cellSize, float mainRoadRange, float mainRoadImpact) : grid(cellSize), mainRoads(mainRoadRange, mainRoadImpact) {}
+
+	// every road proposed during this generation
+	TArray<logicRoadSegment> pool;
+	roadQueue queue;
+	// pool indices of the roads that passed the placement check, in the order they did
+	TArray<int32> placed;
+	// placed roads, by their position in placed
+	RoadSegmentGrid grid;
+	// penalty from every proposed main road
+	RepulsionField mainRoads;
+	FNoiseContext noise;
+	// when bounded, roads have to end inside bounds
+	bool bounded = false;
+	FBox2D bounds;
+};
+
 UCLASS()
 class CITY_API ASpawner : public AActor
 {
@@ -108,6 +148,10 @@ class CITY_API ASpawner : public AActor
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = meshes, meta = (AllowPrivateAccess = "true"))
 		bool generateRoofs = true;
 
+	// generates blocks, plots and houses around origins close to them, keeps them precise far away from the world origin in very large cities
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = performance, meta = (AllowPrivateAccess = "true"))
+		bool localCoordinates = false;
+
 	
 	// whether to use provided texture as heat map or not
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = noise, meta = (AllowPrivateAccess = "true"))
@@ -118,6 +162,29 @@ class CITY_API ASpawner : public AActor
 	// the scale multipleid by noiseScale to give final scale for texture
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = noise, meta = (AllowPrivateAccess = "true"))
 		float noiseTextureScale;
+	// smooth out the texture between pixels
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = noise, meta = (AllowPrivateAccess = "true"))
+		bool bilinearTexture = false;
+
+	// read the noise from cached tiles, values between the tile samples are interpolated so the roads will be slightly different from uncached noise
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = noise, meta = (AllowPrivateAccess = "true"))
+		bool cacheNoise = false;
+	// most tiles kept in the cache
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = noise, meta = (AllowPrivateAccess = "true"))
+		int32 noiseCacheTiles = 256;
+	// width of a cached tile in world units
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = noise, meta = (AllowPrivateAccess = "true"))
+		float noiseCacheTileSize = 20000;
+	// samples along the side of a cached tile
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = noise, meta = (AllowPrivateAccess = "true"))
+		int32 noiseCacheResolution = 64;
+	// octaves of fBm summed up in the cached noise
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = noise, meta = (AllowPrivateAccess = "true"))
+		int32 noiseOctaves = 1;
+
+	// noise used by the last generation
+	FNoiseContext noiseContext;
+	UTexture2D* decodedTexture = nullptr;
 
 	// sidewalk offset
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = sidewalk, meta = (AllowPrivateAccess = "true"))
@@ -135,24 +202,75 @@ class CITY_API ASpawner : public AActor
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = performance, meta = (AllowPrivateAccess = "true"))
 		GenerationMode generationMode;
 
+	// number of threads checking upcoming road proposals ahead of time, 1 checks everything on the calling thread. the result is the same either way
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = performance, meta = (AllowPrivateAccess = "true"))
+		int32 roadThreads = 1;
+	// how many queued proposals are checked ahead of time at once when using more than one thread
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = performance, meta = (AllowPrivateAccess = "true"))
+		int32 speculativeBatchSize = 64;
+
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Generation, meta = (AllowPrivateAccess = "true"))
 		FRandomStream stream;
 
+	// width and height of a chunk when generating the city chunk by chunk
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = chunks, meta = (AllowPrivateAccess = "true"))
+		float chunkSize = 500000;
+	// number of road segments placed in every chunk
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = chunks, meta = (AllowPrivateAccess = "true"))
+		int32 chunkLength = 500;
+	// number of main roads crossing every chunk border
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = chunks, meta = (AllowPrivateAccess = "true"))
+		int32 chunkGatesPerEdge = 2;
+
 public:	
 	// Sets default values for this actor's properties
 	ASpawner();
 
 	void addVertices(FRoadSegment* f);
-	void collideInto(FRoadSegment *s1, FRoadSegment *s2, FVector impactP);
-	void addRoadForward(std::priority_queue<logicRoadSegment*, std::deque<logicRoadSegment*>, roadComparator> &queue, logicRoadSegment* previous, std::vector<logicRoadSegment*> &allsegments);
-	void addRoadSide(std::priority_queue<logicRoadSegment*, std::deque<logicRoadSegment*>, roadComparator> &queue, logicRoadSegment* previous, bool left, float width, std::vector<logicRoadSegment*> &allsegments, RoadType newType);
-	void addExtensions(std::priority_queue<logicRoadSegment*, std::deque<logicRoadSegment*>, roadComparator> &queue, logicRoadSegment* current, std::vector<logicRoadSegment*> &allsegments);
-
-	bool placementCheck(TArray<FRoadSegment*> &segments, logicRoadSegment* current, TMap <int, TArray<FRoadSegment*>*> &map);
+	// bends s1 into s2, returns true if s1 ends up blocking s2 from the front
+	bool collideInto(FRoadSegment *s1, const FRoadSegment *s2, FVector impactP);
+	void addRoadForward(RoadGrowth &growth, int32 previous);
+	void addRoadSide(RoadGrowth &growth, int32 previous, bool left, float width, RoadType newType);
+	void addExtensions(RoadGrowth &growth, int32 current);
+
+	// checks a proposal against the placed roads without changing anything, safe to call from several threads at once
+	void evaluatePlacement(const RoadGrowth &growth, int32 current, PlacementResult &result);
+	bool isStillValid(const RoadGrowth &growth, const PlacementResult &result);
+	// applies the result of evaluatePlacement, returns whether the road can be placed
+	bool placementCheck(RoadGrowth &growth, int32 current, PlacementResult &result);
+	void speculatePlacements(RoadGrowth &growth, TMap<int32, PlacementResult> &speculated);
+	void growRoads(RoadGrowth &growth, int32 maxSegments);
+	void findAttachment(const RoadGrowth &growth, const RoadSegmentGrid *changed, int32 i, AttachResult &result);
+	// extends dangling roads up to maxAttachDistance to connect them with a road in front of them
+	void attachRoads(RoadGrowth &growth);
+
+	// makes the noise context for the current settings
+	void initNoise();
+	UFUNCTION(BlueprintCallable, Category = "Generation")
+	FNoiseContext getNoiseContext() { return noiseContext; }
+	void addStartRoad(RoadGrowth &growth, FVector point, FRotator rotation);
+	TArray<FRoadSegment> finishRoads(RoadGrowth &growth);
 
 	UFUNCTION(BlueprintCallable, Category = "Generation")
 	TArray<FRoadSegment> determineRoadSegments();
 
+	UFUNCTION(BlueprintCallable, Category = "Chunks")
+	FVector getChunkOrigin(FIntPoint chunk);
+	UFUNCTION(BlueprintCallable, Category = "Chunks")
+	FIntPoint getChunkAt(FVector location);
+	float getChunkSize() { return chunkSize; }
+	int32 getChunkSeed(FIntPoint chunk);
+	// adds main roads going into the chunk from the border starting at the corner edge, along x or y
+	void addGateRoads(RoadGrowth &growth, FIntPoint edge, bool alongY, bool inwardPositive);
+
+	// generates the roads of a single chunk, the result only depends on stream and the chunk so chunks can be generated in any order
+	UFUNCTION(BlueprintCallable, Category = "Chunks")
+	TArray<FRoadSegment> determineChunkRoadSegments(FIntPoint chunk);
+
+	// blocks of a single chunk, closed off along the chunk border
+	UFUNCTION(BlueprintCallable, Category = "Chunks")
+	TArray<FMetaPolygon> getChunkSurroundingPolygons(FIntPoint chunk, TArray<FRoadSegment> segments);
+
 	UFUNCTION(BlueprintCallable, Category = "Generation")
 	TArray<FMaterialPolygon> getRoadLines(TArray<FRoadSegment> segments);
 
@@ -170,6 +288,22 @@ public:
 	UFUNCTION(BlueprintCallable, Category = "Test")
 	TArray<FTransform> visualizeNoise(int numSide, float noiseMultiplier, float posMultiplier);
 
+	// generates road networks of doubling size up to maxSegments and logs the time each one took
+	UFUNCTION(BlueprintCallable, Category = "Test")
+	void benchmarkRoadGeneration(int32 maxSegments = 100000);
+
+	// generates the same road network with 1 to 32 threads, logs the speedup and whether the result matched the serial one
+	UFUNCTION(BlueprintCallable, Category = "Test")
+	void benchmarkParallelRoadGeneration();
+
+	// reads the noise for random points one at a time, batched without and with vector instructions, and logs points per second for each
+	UFUNCTION(BlueprintCallable, Category = "Test")
+	void benchmarkNoise(int32 points = 1000000);
+
+	// logs hits, misses and evictions of the noise cache since the last call
+	UFUNCTION(BlueprintCallable, Category = "Test")
+	void logNoiseCacheStats();
+
 	//UFUNCTION(BlueprintCallable, Category = "Generation")
 protected:
 	// Called when the game starts or when spawned
@@ -1,25 +1,33 @@
 #include "City.h"
 #include "ThreadedWorker.h"
+#include "Misc/CoreDelegates.h"
+#include "UObject/GarbageCollection.h"
 
 
+static bool isSooner(const HouseTask &a, const HouseTask &b) {
+	return a.priority < b.priority;
+}
+
+HouseTaskPool* HouseTaskPool::instance = nullptr;
 
-//***********************************************************
-//Thread Worker Starts as NULL, prior to being instanced
-//		This line is essential! Compiler error without it
-ThreadedWorker* ThreadedWorker::Runnable = NULL;
-//***********************************************************
-FThreadSafeCounter  WorkerCounter = 0;
-ThreadedWorker::ThreadedWorker(AHouseBuilder* house)
-	: houseBuilder(house)
+ThreadedWorker::ThreadedWorker(HouseTaskPool *pool_in, int32 index_in)
+	: pool(pool_in), index(index_in)
 {
-	//Link to where data should be stored
-	Thread = FRunnableThread::Create(this, *FString::Printf(TEXT("Thread %i"), WorkerCounter.Increment()), 0, TPri_Normal); //windows default = 8mb for thread, could specify more
+	wake = FPlatformProcess::GetSynchEventFromPool(false);
+	Thread = nullptr;
+}
+
+void ThreadedWorker::start()
+{
+	Thread = FRunnableThread::Create(this, *FString::Printf(TEXT("House worker %i"), index), 0, TPri_Normal); //windows default = 8mb for thread, could specify more
 }
 
 ThreadedWorker::~ThreadedWorker()
 {
 	delete Thread;
 	Thread = NULL;
+	FPlatformProcess::ReturnSynchEventToPool(wake);
+	wake = nullptr;
 }
 
 //Init
@@ -31,16 +39,31 @@ bool ThreadedWorker::Init()
 //Run
 uint32 ThreadedWorker::Run()
 {
-
-	resultingInfo = houseBuilder->getHouseInfo();
-	done = true;
+	while (!pool->stopping) {
+		HouseTask task;
+		if (!pool->take(index, task)) {
+			// work can also show up in the other queues, so don't sleep for long
+			wake->Wait(10);
+			continue;
+		}
+		HouseTaskResult result;
+		result.id = task.id;
+		result.house = task.house;
+		{
+			// the mesh components in the input belong to the house, which can be destroyed while this runs
+			FGCScopeGuard guard;
+			result.info = AHouseBuilder::generateHouseInfo(*task.input);
+		}
+		pool->completed.Enqueue(MoveTemp(result));
+		pool->busyWorkers--;
+	}
 	return 0;
 }
 
 //stop
 void ThreadedWorker::Stop()
 {
-	StopTaskCounter.Increment();
+	wake->Trigger();
 }
 
 void ThreadedWorker::EnsureCompletion()
@@ -49,18 +72,164 @@ void ThreadedWorker::EnsureCompletion()
 	Thread->WaitForCompletion();
 }
 
-void ThreadedWorker::Shutdown()
+
+HouseTaskPool::HouseTaskPool()
+{
+	// leave a core for the game thread
+	int32 threads = FMath::Max(1, FPlatformMisc::NumberOfCoresIncludingHyperthreads() - 1);
+	workers.Reserve(threads);
+	for (int32 i = 0; i < threads; i++)
+		workers.Add(new ThreadedWorker(this, i));
+	// only start the threads once the array is done changing, they read it in take
+	for (ThreadedWorker *worker : workers)
+		worker->start();
+	tickHandle = FTicker::GetCoreTicker().AddTicker(FTickerDelegate::CreateRaw(this, &HouseTaskPool::tick));
+}
+
+HouseTaskPool::~HouseTaskPool()
+{
+	FTicker::GetCoreTicker().RemoveTicker(tickHandle);
+	stopping = true;
+	for (ThreadedWorker *worker : workers) {
+		worker->EnsureCompletion();
+		delete worker;
+	}
+	workers.Empty();
+}
+
+HouseTaskPool& HouseTaskPool::get()
+{
+	if (!instance) {
+		instance = new HouseTaskPool();
+		FCoreDelegates::OnPreExit.AddStatic(&HouseTaskPool::shutdown);
+	}
+	return *instance;
+}
+
+bool HouseTaskPool::hasIdleWorkers()
+{
+	return !instance || instance->busyWorkers < instance->workers.Num();
+}
+
+void HouseTaskPool::shutdown()
+{
+	if (instance) {
+		delete instance;
+		instance = nullptr;
+	}
+}
+
+bool HouseTaskPool::take(int32 worker, HouseTask &task)
 {
-	if (Runnable)
+	ThreadedWorker *own = workers[worker];
 	{
-		Runnable->EnsureCompletion();
-		delete Runnable;
-		Runnable = NULL;
+		FScopeLock lock(&own->queueLock);
+		if (own->queue.Num() > 0) {
+			own->queue.HeapPop(task, isSooner, false);
+			busyWorkers++;
+			return true;
+		}
+	}
+	// own queue is empty, steal the soonest task of the other queues. the tops can change between looking and popping, so try again if the chosen queue ran dry
+	while (true) {
+		ThreadedWorker *best = nullptr;
+		float bestPriority = 0;
+		for (int32 i = 1; i < workers.Num(); i++) {
+			ThreadedWorker *victim = workers[(worker + i) % workers.Num()];
+			FScopeLock lock(&victim->queueLock);
+			if (victim->queue.Num() > 0 && (!best || victim->queue.HeapTop().priority < bestPriority)) {
+				best = victim;
+				bestPriority = victim->queue.HeapTop().priority;
+			}
+		}
+		if (!best)
+			return false;
+		FScopeLock lock(&best->queueLock);
+		if (best->queue.Num() > 0) {
+			best->queue.HeapPop(task, isSooner, false);
+			busyWorkers++;
+			return true;
+		}
 	}
 }
 
-bool ThreadedWorker::IsThreadFinished()
+uint32 HouseTaskPool::submit(AHouseBuilder *house, float priority, uint32 maxInFlight)
 {
-	if (Runnable) return Runnable->IsFinished();
+	if (++nextId == 0)
+		nextId = 1;
+	live.Add(nextId);
+	HouseTask task{ nextId, house, MakeShareable(new HouseTaskInput(house->getTaskInput())), priority, maxInFlight };
+	if (inFlight < maxInFlight)
+		dispatch(task);
+	else
+		waiting.HeapPush(task, isSooner);
+	return task.id;
+}
+
+void HouseTaskPool::dispatch(const HouseTask &task)
+{
+	inFlight++;
+	ThreadedWorker *worker = workers[nextWorker];
+	nextWorker = (nextWorker + 1) % workers.Num();
+	{
+		FScopeLock lock(&worker->queueLock);
+		worker->queue.HeapPush(task, isSooner);
+	}
+	worker->wake->Trigger();
+}
+
+void HouseTaskPool::dispatchWaiting()
+{
+	while (waiting.Num() > 0 && inFlight < waiting.HeapTop().maxInFlight) {
+		HouseTask task;
+		waiting.HeapPop(task, isSooner, false);
+		dispatch(task);
+	}
+}
+
+void HouseTaskPool::cancel(uint32 id)
+{
+	if (live.Remove(id) == 0)
+		return;
+	auto hasId = [id](const HouseTask &task) { return task.id == id; };
+	int32 place = waiting.IndexOfByPredicate(hasId);
+	if (place != INDEX_NONE) {
+		waiting.HeapRemoveAt(place, isSooner, false);
+		return;
+	}
+	bool removed = false;
+	for (ThreadedWorker *worker : workers) {
+		FScopeLock lock(&worker->queueLock);
+		place = worker->queue.IndexOfByPredicate(hasId);
+		if (place != INDEX_NONE) {
+			worker->queue.HeapRemoveAt(place, isSooner, false);
+			removed = true;
+			break;
+		}
+	}
+	// if it's already running, the result still counts as in flight until drain throws it away
+	if (removed) {
+		inFlight--;
+		dispatchWaiting();
+	}
+}
+
+void HouseTaskPool::drain(double timeBudget)
+{
+	double begin = FPlatformTime::Seconds();
+	HouseTaskResult result;
+	while (completed.Dequeue(result)) {
+		inFlight--;
+		if (live.Remove(result.id) > 0)
+			result.house->receiveHouseInfo(MoveTemp(result.info));
+		if (FPlatformTime::Seconds() - begin > timeBudget)
+			break;
+	}
+	dispatchWaiting();
+}
+
+bool HouseTaskPool::tick(float DeltaTime)
+{
+	drain(resultTimeBudget);
 	return true;
-}
\ No newline at end of file
+}
@@ -1,43 +1,75 @@
 #pragma once
 
 #include "HouseBuilder.h"
+#include "BaseLibrary.h"
+#include "Containers/Queue.h"
+#include "Containers/Ticker.h"
+#include "atomic"
 
-// this is a multi threaded worker for generating the house data for single houses (that being the main bottleneck in the program) faster
+// generates the house data for single houses (that being the main bottleneck in the program) on a fixed number of threads sized to the machine.
+// every thread has its own queue, closest houses first, and takes work from the others when its own queue runs out. finished houses are
+// handed back through a queue the pool empties on the game thread every frame, a few at a time so building their meshes doesn't stall it.
+// the houses themselves don't have to tick while they wait
 
 class AHouseBuilder;
+class UHierarchicalInstancedStaticMeshComponent;
+
+// everything house generation reads, copied from the house when its task is submitted so the workers never touch the house itself
+struct HouseTaskInput {
+	FHousePolygon f;
+	float floorHeight;
+	int makeInterestingAttempts;
+	float maxChangeIntensity;
+	bool generateRoofs;
+	bool shellOnly;
+	// only read for mesh bounds, the workers hold off garbage collection while generating so the components can't be freed under them
+	TMap<FString, UHierarchicalInstancedStaticMeshComponent*> map;
+};
+
+struct HouseTask {
+	uint32 id;
+	// only used on the game thread to deliver the result
+	AHouseBuilder *house;
+	TSharedPtr<const HouseTaskInput, ESPMode::ThreadSafe> input;
+	// lower is sooner
+	float priority;
+	// held back while this many tasks are being worked on
+	uint32 maxInFlight;
+};
+
+struct HouseTaskResult {
+	uint32 id;
+	AHouseBuilder *house;
+	FHouseInfo info;
+};
+
+class HouseTaskPool;
+
 //~~~~~ Multi Threading ~~~
 class ThreadedWorker : public FRunnable
 {
-	/** Singleton instance, can access the thread any time via static accessor, if it is active! */
-	static  ThreadedWorker* Runnable;
+	friend class HouseTaskPool;
+
+	HouseTaskPool *pool;
+	int32 index;
 
 	/** Thread to run the worker FRunnable on */
 	FRunnableThread* Thread;
 
-	AHouseBuilder *houseBuilder;
-	//FHousePolygon housePol;
-
-	/** Stop this thread? Uses Thread Safe Counter */
-	FThreadSafeCounter StopTaskCounter;
-
-private:
+	// tasks given to this worker, a heap with the lowest priority on top
+	TArray<HouseTask> queue;
+	FCriticalSection queueLock;
+	// triggered when a task is added to the queue
+	FEvent *wake;
 
 public:
-	FHouseInfo resultingInfo;
-	bool done = false;
-
-	//Done?
-	bool IsFinished() const
-	{
-		return done;
-	}
-
-	//~~~ Thread Core Functions ~~~
-
 	//Constructor / Destructor
-	ThreadedWorker(AHouseBuilder *house);
+	ThreadedWorker(HouseTaskPool *pool, int32 index);
 	virtual ~ThreadedWorker();
 
+	// starts the thread, only called once every worker of the pool exists
+	void start();
+
 	// Begin FRunnable interface.
 	virtual bool Init();
 	virtual uint32 Run();
@@ -46,10 +78,59 @@ public:
 
 	/** Makes sure this thread has stopped properly */
 	void EnsureCompletion();
+};
+
+class HouseTaskPool
+{
+	friend class ThreadedWorker;
+
+	static HouseTaskPool *instance;
+
+	TArray<ThreadedWorker*> workers;
+	std::atomic<bool> stopping{ false };
+	// workers generating a house right now
+	std::atomic<int32> busyWorkers{ 0 };
+	// written by the workers, only read on the game thread
+	TQueue<HouseTaskResult, EQueueMode::Mpsc> completed;
+
+	// everything below is only used on the game thread
+	uint32 nextId = 0;
+	int32 nextWorker = 0;
+	// tasks that are neither cancelled nor delivered yet, results for anything else are thrown away
+	TSet<uint32> live;
+	// tasks handed to the workers and not delivered or cancelled yet
+	uint32 inFlight = 0;
+	// tasks held back by their maxInFlight, a heap like the worker queues
+	TArray<HouseTask> waiting;
+	FDelegateHandle tickHandle;
+
+	HouseTaskPool();
+	~HouseTaskPool();
+
+	// pops the next task for a worker, from its own queue if it has any and otherwise the soonest top of the other queues
+	bool take(int32 worker, HouseTask &task);
+	void dispatch(const HouseTask &task);
+	// dispatches waiting tasks as long as their maxInFlight allows it
+	void dispatchWaiting();
+	bool tick(float DeltaTime);
+
+public:
+	// most time spent handing finished houses to their builders in a frame
+	double resultTimeBudget = 0.008;
+
+	static HouseTaskPool& get();
+	// whether some of the workers are waiting for work, nested parallel work only makes sense then since the busy workers already use up their cores
+	static bool hasIdleWorkers();
+	static void shutdown();
+
+	// queues house generation for the house, returns the id to cancel it with. it waits in the pool while maxInFlight or more houses are being generated
+	uint32 submit(AHouseBuilder *house, float priority, uint32 maxInFlight);
 
-	/** Shuts down the thread. Static so it can easily be called from outside the thread context */
-	static void Shutdown();
+	// removes the task if it hasn't started yet, its result is never delivered. returns right away, a running task finishes on its own and its result is thrown away
+	void cancel(uint32 id);
 
-	static bool IsThreadFinished();
+	// hands finished houses to their builders until the time budget is spent, at least one is handed over every call. called every frame by the core ticker
+	void drain(double timeBudget);
 
-};
\ No newline at end of file
+	int32 getNumThreads() const { return workers.Num(); }
+};
@@ -28,6 +28,14 @@
 #include "simplexnoise.h"
 #include <cstdint>  // int32_t/uint8_t
 
+// the batched 2D noise uses SSE2 on x86, everywhere else it falls back to the scalar version
+#if PLATFORM_ENABLE_VECTORINTRINSICS && (defined(_M_X64) || defined(__x86_64__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__))
+#define SIMPLEX_SSE2 1
+#include <emmintrin.h>
+#else
+#define SIMPLEX_SSE2 0
+#endif
+
 /**
  * Computes the largest integer value not greater than the float one
  *
@@ -269,6 +277,133 @@ float SimplexNoise::simplexnoise(float x, float y) {
 }
 
 
+/**
+ * 2D Perlin simplex noise for many points, scalar version
+ *
+ * @param[in]  x     float coordinates
+ * @param[in]  y     float coordinates
+ * @param[out] out   noise values, same as calling simplexnoise(x[i], y[i]) for every point
+ * @param[in]  count number of points
+ */
+void SimplexNoise::simplexnoiseScalar(const float* x, const float* y, float* out, size_t count) {
+    for (size_t k = 0; k < count; k++) {
+        out[k] = simplexnoise(x[k], y[k]);
+    }
+}
+
+#if SIMPLEX_SSE2
+
+// gradient of simplexnoise(x, y) for four lanes, h holds the hash of the corner
+static inline __m128 grad4(__m128i h, __m128 x, __m128 y) {
+    const __m128i four = _mm_set1_epi32(4);
+    h = _mm_and_si128(h, _mm_set1_epi32(0x3F));
+    __m128 useX = _mm_castsi128_ps(_mm_cmplt_epi32(h, four));
+    __m128 u = _mm_or_ps(_mm_and_ps(useX, x), _mm_andnot_ps(useX, y));
+    __m128 v = _mm_or_ps(_mm_and_ps(useX, y), _mm_andnot_ps(useX, x));
+    // flipping the sign bit is the same as negating
+    const __m128i signBit = _mm_set1_epi32(0x80000000);
+    __m128 flipU = _mm_castsi128_ps(_mm_and_si128(_mm_cmpeq_epi32(_mm_and_si128(h, _mm_set1_epi32(1)), _mm_set1_epi32(1)), signBit));
+    __m128 flipV = _mm_castsi128_ps(_mm_and_si128(_mm_cmpeq_epi32(_mm_and_si128(h, _mm_set1_epi32(2)), _mm_set1_epi32(2)), signBit));
+    v = _mm_mul_ps(_mm_set1_ps(2.0f), v);
+    return _mm_add_ps(_mm_xor_ps(u, flipU), _mm_xor_ps(v, flipV));
+}
+
+// contribution of one corner, zero where t is negative
+static inline __m128 corner4(__m128 t, __m128i h, __m128 x, __m128 y) {
+    __m128 inside = _mm_cmpge_ps(t, _mm_setzero_ps());
+    t = _mm_mul_ps(t, t);
+    __m128 n = _mm_mul_ps(_mm_mul_ps(t, t), grad4(h, x, y));
+    return _mm_and_ps(inside, n);
+}
+
+// four points at a time, every step is done in the same order as the scalar version so the results are identical
+static void simplexnoiseSSE2(const float* x, const float* y, float* out, size_t count) {
+    const __m128 F2 = _mm_set1_ps(0.366025403f);
+    const __m128 G2 = _mm_set1_ps(0.211324865f);
+    const __m128 G2x2 = _mm_set1_ps(2.0f * 0.211324865f);
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 half = _mm_set1_ps(0.5f);
+    const __m128i onei = _mm_set1_epi32(1);
+
+    alignas(16) int32_t h0[4];
+    alignas(16) int32_t h1[4];
+    alignas(16) int32_t h2[4];
+    alignas(16) int32_t ia[4];
+    alignas(16) int32_t ja[4];
+    alignas(16) int32_t i1a[4];
+
+    size_t k = 0;
+    for (; k + 4 <= count; k += 4) {
+        __m128 xv = _mm_loadu_ps(x + k);
+        __m128 yv = _mm_loadu_ps(y + k);
+
+        __m128 s = _mm_mul_ps(_mm_add_ps(xv, yv), F2);
+        __m128 xs = _mm_add_ps(xv, s);
+        __m128 ys = _mm_add_ps(yv, s);
+        // fastfloor, truncate and step down where that rounded up
+        __m128i i = _mm_cvttps_epi32(xs);
+        __m128i j = _mm_cvttps_epi32(ys);
+        i = _mm_add_epi32(i, _mm_castps_si128(_mm_cmplt_ps(xs, _mm_cvtepi32_ps(i))));
+        j = _mm_add_epi32(j, _mm_castps_si128(_mm_cmplt_ps(ys, _mm_cvtepi32_ps(j))));
+
+        __m128 t = _mm_mul_ps(_mm_cvtepi32_ps(_mm_add_epi32(i, j)), G2);
+        __m128 x0 = _mm_sub_ps(xv, _mm_sub_ps(_mm_cvtepi32_ps(i), t));
+        __m128 y0 = _mm_sub_ps(yv, _mm_sub_ps(_mm_cvtepi32_ps(j), t));
+
+        __m128i lower = _mm_castps_si128(_mm_cmpgt_ps(x0, y0));
+        __m128i i1 = _mm_and_si128(lower, onei);
+        __m128i j1 = _mm_andnot_si128(lower, onei);
+
+        __m128 x1 = _mm_add_ps(_mm_sub_ps(x0, _mm_cvtepi32_ps(i1)), G2);
+        __m128 y1 = _mm_add_ps(_mm_sub_ps(y0, _mm_cvtepi32_ps(j1)), G2);
+        __m128 x2 = _mm_add_ps(_mm_sub_ps(x0, one), G2x2);
+        __m128 y2 = _mm_add_ps(_mm_sub_ps(y0, one), G2x2);
+
+        // the permutation lookups have no vector form in SSE2
+        _mm_store_si128(reinterpret_cast<__m128i*>(ia), i);
+        _mm_store_si128(reinterpret_cast<__m128i*>(ja), j);
+        _mm_store_si128(reinterpret_cast<__m128i*>(i1a), i1);
+        for (int l = 0; l < 4; l++) {
+            h0[l] = hash(ia[l] + hash(ja[l]));
+            h1[l] = hash(ia[l] + i1a[l] + hash(ja[l] + 1 - i1a[l]));
+            h2[l] = hash(ia[l] + 1 + hash(ja[l] + 1));
+        }
+
+        __m128 t0 = _mm_sub_ps(_mm_sub_ps(half, _mm_mul_ps(x0, x0)), _mm_mul_ps(y0, y0));
+        __m128 t1 = _mm_sub_ps(_mm_sub_ps(half, _mm_mul_ps(x1, x1)), _mm_mul_ps(y1, y1));
+        __m128 t2 = _mm_sub_ps(_mm_sub_ps(half, _mm_mul_ps(x2, x2)), _mm_mul_ps(y2, y2));
+        __m128 n0 = corner4(t0, _mm_load_si128(reinterpret_cast<const __m128i*>(h0)), x0, y0);
+        __m128 n1 = corner4(t1, _mm_load_si128(reinterpret_cast<const __m128i*>(h1)), x1, y1);
+        __m128 n2 = corner4(t2, _mm_load_si128(reinterpret_cast<const __m128i*>(h2)), x2, y2);
+
+        _mm_storeu_ps(out + k, _mm_mul_ps(_mm_set1_ps(45.23065f), _mm_add_ps(_mm_add_ps(n0, n1), n2)));
+    }
+    SimplexNoise::simplexnoiseScalar(x + k, y + k, out + k, count - k);
+}
+
+#endif
+
+/**
+ * 2D Perlin simplex noise for many points, uses SSE2 when available
+ *
+ * @param[in]  x     float coordinates
+ * @param[in]  y     float coordinates
+ * @param[out] out   noise values, same as calling simplexnoise(x[i], y[i]) for every point
+ * @param[in]  count number of points
+ */
+void SimplexNoise::simplexnoise(const float* x, const float* y, float* out, size_t count) {
+#if SIMPLEX_SSE2
+    simplexnoiseSSE2(x, y, out, count);
+#else
+    simplexnoiseScalar(x, y, out, count);
+#endif
+}
+
+bool SimplexNoise::isVectorized() {
+    return SIMPLEX_SSE2 != 0;
+}
+
+
 /**
  * Fractal/Fractional Brownian Motion (fBm) summation of 1D Perlin Simplex noise
  *
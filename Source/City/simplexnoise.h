@@ -19,6 +19,11 @@ public:
     static float simplexnoise(float x);
     // 2D Perlin simplex noise
     static float simplexnoise(float x, float y);
+    // 2D Perlin simplex noise for count points, gives the same values as calling the function above for each point
+    static void simplexnoise(const float* x, const float* y, float* out, size_t count);
+    static void simplexnoiseScalar(const float* x, const float* y, float* out, size_t count);
+    // whether simplexnoise for many points uses vector instructions on this platform
+    static bool isVectorized();
 
     // Fractal/Fractional Brownian Motion (fBm) noise summation
     float fractal(size_t octaves, float x) const;